@@ -0,0 +1,339 @@
+/*
+iris_dispatcher_bench.cpp
+
+The MIT License (MIT)
+
+Copyright (c) 2025-2026 PaintDream
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Microbenchmarks of iris_dispatcher.h, run across thread counts and printed as JSON to diff between releases:
+//   queue_poll_one: threads queue a task and poll_one() it themselves
+//   wakeup: latency from queue() on an external thread until an idle (parked) pool thread runs the task
+//   warp_queue_routine / warp_queue_routine_post: an external thread posts routines to warps
+//   preempt_guard: all pool threads preempt one warp
+//   switch_hop: a coroutine switching between two warps
+//   dispatcher_dag: layered DAG of iris_dispatcher_t routines, each depends on two of the previous layer
+
+#include "iris/iris_common.inl"
+#include "iris/iris_dispatcher.h"
+#include "iris/iris_coroutine.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace iris;
+using clock_type_t = std::chrono::steady_clock;
+using worker_t = iris_async_worker_t<>;
+using warp_t = iris_warp_t<worker_t>;
+using dispatcher_t = iris_dispatcher_t<warp_t>;
+
+struct bench_result_t {
+	std::string name;
+	size_t thread_count = 0;
+	size_t iterations = 0;
+	double seconds = 0;
+	std::vector<std::pair<std::string, double>> metrics;
+};
+
+static double elapsed(clock_type_t::time_point begin) {
+	return std::chrono::duration<double>(clock_type_t::now() - begin).count();
+}
+
+static void spin_until(const std::atomic<size_t>& counter, size_t value) {
+	while (counter.load(std::memory_order_acquire) < value) {
+		std::this_thread::yield();
+	}
+}
+
+static bench_result_t bench_queue_poll_one(size_t thread_count, size_t iterations) {
+	// no internal threads, every thread polls its own tasks
+	worker_t worker(0);
+	for (size_t i = 0; i < thread_count; i++) {
+		worker.append(std::thread());
+	}
+
+	worker.start();
+	std::atomic<size_t> executed = 0;
+	std::vector<std::thread> threads;
+	size_t per_thread = iterations / thread_count;
+	clock_type_t::time_point begin = clock_type_t::now();
+	for (size_t i = 0; i < thread_count; i++) {
+		threads.emplace_back([&worker, &executed, per_thread, i]() {
+			worker.make_current(i);
+			for (size_t k = 0; k < per_thread; k++) {
+				worker.queue([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); });
+				worker.poll_one();
+			}
+
+			while (worker.poll_one()) {}
+			worker.make_current(~size_t(0));
+		});
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	while (worker.poll_one()) {}
+	bench_result_t result { "queue_poll_one", thread_count, per_thread * thread_count, elapsed(begin), {} };
+	worker.terminate();
+	worker.join();
+
+	result.metrics.emplace_back("tasks_per_second", result.iterations / result.seconds);
+	return result;
+}
+
+static bench_result_t bench_wakeup(size_t thread_count, size_t iterations) {
+	worker_t worker(thread_count);
+	worker.start();
+
+	size_t samples_count = std::max(std::min(iterations / 100, size_t(2000)), size_t(10));
+	std::vector<double> samples;
+	samples.reserve(samples_count);
+	std::atomic<size_t> executed = 0;
+	clock_type_t::time_point begin = clock_type_t::now();
+	for (size_t i = 0; i < samples_count; i++) {
+		// let the pool park
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+		clock_type_t::time_point queued = clock_type_t::now();
+		std::atomic<int64_t> started = 0;
+		worker.queue([&started, &executed]() {
+			started.store(clock_type_t::now().time_since_epoch().count(), std::memory_order_relaxed);
+			executed.fetch_add(1, std::memory_order_release);
+		});
+
+		spin_until(executed, i + 1);
+		samples.emplace_back(std::chrono::duration<double, std::micro>(clock_type_t::duration(started.load(std::memory_order_relaxed)) - queued.time_since_epoch()).count());
+	}
+
+	bench_result_t result { "wakeup", thread_count, samples_count, elapsed(begin), {} };
+	worker.terminate();
+	worker.join();
+
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double ratio) {
+		return samples[std::min(samples.size() - 1, size_t(ratio * samples.size()))];
+	};
+
+	result.metrics.emplace_back("p50_us", percentile(0.5));
+	result.metrics.emplace_back("p99_us", percentile(0.99));
+	result.metrics.emplace_back("max_us", samples.back());
+	return result;
+}
+
+template <bool post>
+static bench_result_t bench_warp_queue(size_t thread_count, size_t iterations) {
+	worker_t worker(thread_count);
+	worker.start();
+
+	std::vector<std::unique_ptr<warp_t>> warps;
+	for (size_t i = 0; i < thread_count * 4; i++) {
+		warps.emplace_back(std::make_unique<warp_t>(worker));
+	}
+
+	std::atomic<size_t> executed = 0;
+	clock_type_t::time_point begin = clock_type_t::now();
+	for (size_t i = 0; i < iterations; i++) {
+		warp_t& warp = *warps[i % warps.size()];
+		auto routine = [&executed]() { executed.fetch_add(1, std::memory_order_relaxed); };
+		if constexpr (post) {
+			warp.queue_routine_post(std::move(routine));
+		} else {
+			warp.queue_routine(std::move(routine));
+		}
+	}
+
+	double submit_seconds = elapsed(begin);
+	spin_until(executed, iterations);
+	bench_result_t result { post ? "warp_queue_routine_post" : "warp_queue_routine", thread_count, iterations, elapsed(begin), {} };
+	worker.terminate();
+	worker.join();
+
+	result.metrics.emplace_back("submit_ns", submit_seconds * 1e9 / iterations);
+	result.metrics.emplace_back("routines_per_second", iterations / result.seconds);
+	return result;
+}
+
+static bench_result_t bench_preempt_guard(size_t thread_count, size_t iterations) {
+	worker_t worker(thread_count);
+	worker.start();
+	warp_t warp(worker);
+
+	std::atomic<size_t> finished = 0;
+	std::atomic<size_t> acquired = 0;
+	size_t per_thread = iterations / thread_count;
+	clock_type_t::time_point begin = clock_type_t::now();
+	for (size_t i = 0; i < thread_count; i++) {
+		worker.queue([&warp, &finished, &acquired, per_thread]() {
+			size_t count = 0;
+			for (size_t k = 0; k < per_thread; k++) {
+				warp_t::preempt_guard_t guard(warp, 0);
+				if (guard) {
+					count++;
+				}
+			}
+
+			acquired.fetch_add(count, std::memory_order_relaxed);
+			finished.fetch_add(1, std::memory_order_release);
+		});
+	}
+
+	spin_until(finished, thread_count);
+	bench_result_t result { "preempt_guard", thread_count, per_thread * thread_count, elapsed(begin), {} };
+	worker.terminate();
+	worker.join();
+
+	result.metrics.emplace_back("attempts_per_second", result.iterations / result.seconds);
+	result.metrics.emplace_back("success_ratio", double(acquired.load(std::memory_order_relaxed)) / double(std::max(result.iterations, size_t(1))));
+	return result;
+}
+
+static iris_coroutine_t<void> switch_hops(warp_t& first, warp_t& second, size_t count, std::atomic<size_t>& finished) {
+	for (size_t i = 0; i < count; i++) {
+		co_await iris_switch(&first);
+		co_await iris_switch(&second);
+	}
+
+	co_await iris_switch<warp_t>(nullptr);
+	finished.fetch_add(1, std::memory_order_release);
+}
+
+static bench_result_t bench_switch_hop(size_t thread_count, size_t iterations) {
+	worker_t worker(thread_count);
+	worker.start();
+
+	// one pair of warps per thread
+	std::vector<std::unique_ptr<warp_t>> warps;
+	for (size_t i = 0; i < thread_count * 2; i++) {
+		warps.emplace_back(std::make_unique<warp_t>(worker));
+	}
+
+	std::atomic<size_t> finished = 0;
+	size_t per_coroutine = std::max(iterations / thread_count / 2, size_t(1));
+	std::vector<iris_coroutine_t<void>> coroutines;
+	clock_type_t::time_point begin = clock_type_t::now();
+	for (size_t i = 0; i < thread_count; i++) {
+		coroutines.emplace_back(switch_hops(*warps[i * 2], *warps[i * 2 + 1], per_coroutine, finished));
+		coroutines.back().run();
+	}
+
+	spin_until(finished, thread_count);
+	size_t hops = per_coroutine * 2 * thread_count;
+	bench_result_t result { "switch_hop", thread_count, hops, elapsed(begin), {} };
+	worker.terminate();
+	worker.join();
+
+	// coroutines hop concurrently, so per hop latency is measured per coroutine
+	result.metrics.emplace_back("hop_ns", result.seconds * 1e9 / per_coroutine / 2);
+	result.metrics.emplace_back("hops_per_second", hops / result.seconds);
+	return result;
+}
+
+static bench_result_t bench_dispatcher_dag(size_t thread_count, size_t iterations) {
+	worker_t worker(thread_count);
+	worker.start();
+	dispatcher_t dispatcher(worker);
+
+	static constexpr size_t width = 64;
+	size_t layers = std::max(iterations / width, size_t(2));
+	std::atomic<size_t> executed = 0;
+	std::vector<dispatcher_t::routine_handle_t> previous, current;
+	std::vector<dispatcher_t::routine_handle_t> all;
+	all.reserve(layers * width);
+
+	clock_type_t::time_point begin = clock_type_t::now();
+	for (size_t layer = 0; layer < layers; layer++) {
+		for (size_t i = 0; i < width; i++) {
+			dispatcher_t::routine_handle_t routine = dispatcher.allocate(nullptr, [&executed](const dispatcher_t::routine_handle_t&) {
+				executed.fetch_add(1, std::memory_order_relaxed);
+			});
+
+			if (layer != 0) {
+				dispatcher.order(all[(layer - 1) * width + i], routine);
+				dispatcher.order(all[(layer - 1) * width + (i + 1) % width], routine);
+			}
+
+			all.emplace_back(std::move(routine));
+		}
+	}
+
+	double build_seconds = elapsed(begin);
+	for (auto& routine : all) {
+		dispatcher.dispatch(std::move(routine));
+	}
+
+	spin_until(executed, layers * width);
+	while (dispatcher.get_pending_count() != 0) {
+		std::this_thread::yield();
+	}
+
+	bench_result_t result { "dispatcher_dag", thread_count, layers * width, elapsed(begin), {} };
+	worker.terminate();
+	worker.join();
+
+	result.metrics.emplace_back("build_ns", build_seconds * 1e9 / result.iterations);
+	result.metrics.emplace_back("routines_per_second", result.iterations / result.seconds);
+	return result;
+}
+
+int main(int argc, char* argv[]) {
+	size_t iterations = 100000;
+	std::vector<size_t> thread_counts;
+	if (argc > 1) iterations = std::max(strtoul(argv[1], nullptr, 10), 1ul);
+	for (int i = 2; i < argc; i++) {
+		thread_counts.emplace_back(std::max(strtoul(argv[i], nullptr, 10), 1ul));
+	}
+
+	if (thread_counts.empty()) {
+		thread_counts = { 1, 2, 4, 8 };
+	}
+
+	std::vector<bench_result_t> results;
+	for (size_t thread_count : thread_counts) {
+		results.emplace_back(bench_queue_poll_one(thread_count, iterations));
+		results.emplace_back(bench_wakeup(thread_count, iterations));
+		results.emplace_back(bench_warp_queue<false>(thread_count, iterations));
+		results.emplace_back(bench_warp_queue<true>(thread_count, iterations));
+		results.emplace_back(bench_preempt_guard(thread_count, iterations));
+		results.emplace_back(bench_switch_hop(thread_count, iterations));
+		results.emplace_back(bench_dispatcher_dag(thread_count, iterations));
+	}
+
+	printf("{\n\t\"hardware_concurrency\": %u,\n\t\"benchmarks\": [\n", std::thread::hardware_concurrency());
+	for (size_t i = 0; i < results.size(); i++) {
+		const bench_result_t& result = results[i];
+		printf("\t\t{ \"name\": \"%s\", \"threads\": %zu, \"iterations\": %zu, \"seconds\": %.6f", result.name.c_str(), result.thread_count, result.iterations, result.seconds);
+		for (auto& metric : result.metrics) {
+			printf(", \"%s\": %.3f", metric.first.c_str(), metric.second);
+		}
+
+		printf(" }%s\n", i + 1 == results.size() ? "" : ",");
+	}
+
+	printf("\t]\n}\n");
+	return EXIT_SUCCESS;
+}
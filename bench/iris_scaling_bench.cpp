@@ -0,0 +1,135 @@
+/*
+iris_scaling_bench.cpp
+
+The MIT License (MIT)
+
+Copyright (c) 2025-2026 PaintDream
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Measures how submit/poll throughput of iris_async_worker_t scales with thread count.
+// Every pool thread runs a few chains of tiny tasks, each task queues the next one of its chain,
+// so the run is dominated by shared scheduler state (task heads, counters, allocators) rather than by work.
+// Efficiency is tasks/s per thread relative to the first thread count, 1.0 means linear scaling.
+
+#include "iris/iris_common.inl"
+#include "iris/iris_dispatcher.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace iris;
+using clock_type_t = std::chrono::steady_clock;
+
+struct bench_config_t {
+	size_t thread_count = 1;
+	size_t task_count = 200000; // per thread
+	size_t chain_count = 8; // chains per thread
+	size_t work_spin = 50; // busy loop per task
+};
+
+template <typename worker_t>
+struct bench_runner_t {
+	explicit bench_runner_t(const bench_config_t& c) : config(c), worker(c.thread_count) {
+		completed.store(0, std::memory_order_relaxed);
+		remaining.store(c.task_count * c.thread_count, std::memory_order_relaxed);
+	}
+
+	void execute() {
+		volatile size_t sink = 0;
+		for (size_t i = 0; i < config.work_spin; i++) {
+			sink = sink + i;
+		}
+
+		if (remaining.fetch_sub(1, std::memory_order_relaxed) > config.chain_count * config.thread_count) {
+			worker.queue([this]() { execute(); });
+		} else {
+			completed.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	double run() {
+		size_t chain_total = config.chain_count * config.thread_count;
+		worker.start();
+		clock_type_t::time_point begin = clock_type_t::now();
+
+		// seed chains from inside the pool, so each thread mostly submits to itself
+		for (size_t i = 0; i < config.thread_count; i++) {
+			worker.queue([this]() {
+				for (size_t k = 0; k < config.chain_count; k++) {
+					worker.queue([this]() { execute(); });
+				}
+			});
+		}
+
+		while (completed.load(std::memory_order_acquire) != chain_total) {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+		double seconds = std::chrono::duration<double>(clock_type_t::now() - begin).count();
+		worker.terminate();
+		worker.join();
+
+		return (config.task_count * config.thread_count + config.thread_count) / seconds;
+	}
+
+	const bench_config_t& config;
+	worker_t worker;
+	std::atomic<size_t> completed;
+	std::atomic<size_t> remaining;
+};
+
+template <typename worker_t>
+void bench_mode(const char* name, bench_config_t config, const std::vector<size_t>& thread_counts) {
+	double base = 0;
+	for (size_t thread_count : thread_counts) {
+		config.thread_count = thread_count;
+		double rate = bench_runner_t<worker_t>(config).run();
+		double per_thread = rate / thread_count;
+		if (base == 0) {
+			base = per_thread;
+		}
+
+		printf("%-20s threads=%zu tasks/s=%.0f tasks/s/thread=%.0f efficiency=%.2f\n", name, thread_count, rate, per_thread, per_thread / base);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	bench_config_t config;
+	std::vector<size_t> thread_counts;
+	if (argc > 1) config.task_count = strtoul(argv[1], nullptr, 10);
+	for (int i = 2; i < argc; i++) {
+		thread_counts.emplace_back(strtoul(argv[i], nullptr, 10));
+	}
+
+	if (thread_counts.empty()) {
+		thread_counts = { 1, 2, 4, 8, 16, 32, 64 };
+	}
+
+	// padded layout (default) against the packed one, task heads and the waiting task counter share cache lines
+	bench_mode<iris_async_worker_t<>>("stack", config, thread_counts);
+	bench_mode<iris_async_worker_t<std::thread, std::function<void()>, iris_default_object_allocator_t, 4, 4, false, false>>("stack_packed", config, thread_counts);
+	bench_mode<iris_async_worker_t<std::thread, std::function<void()>, iris_default_object_allocator_t, 4, 4, true>>("work_stealing", config, thread_counts);
+	bench_mode<iris_async_worker_t<std::thread, std::function<void()>, iris_default_object_allocator_t, 4, 4, true, false>>("work_stealing_packed", config, thread_counts);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+/*
+iris_scheduler_bench.cpp
+
+The MIT License (MIT)
+
+Copyright (c) 2025-2026 PaintDream
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Compares the scheduling modes of iris_async_worker_t under sustained load: LIFO task stacks vs FIFO work-stealing.
+// An external thread keeps injecting root tasks, each root task spawns a chain of follow-up tasks from the pool threads.
+// Queue latency (queued -> started) percentiles and max show how fair each mode is, a LIFO scheduler starves old tasks.
+
+#include "iris/iris_common.inl"
+#include "iris/iris_dispatcher.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace iris;
+using clock_type_t = std::chrono::steady_clock;
+
+struct bench_config_t {
+	size_t thread_count = 4;
+	size_t task_count = 200000; // root tasks
+	size_t chain_length = 4; // follow-up tasks per root task
+	size_t work_spin = 200; // busy loop per task
+	size_t in_flight = 256; // max root tasks in flight
+};
+
+template <typename worker_t>
+struct bench_runner_t {
+	explicit bench_runner_t(const bench_config_t& c) : config(c), worker(c.thread_count), samples(c.thread_count + 1) {
+		completed.store(0, std::memory_order_relaxed);
+		for (auto& s : samples) {
+			s.reserve((config.task_count * (config.chain_length + 1)) / (config.thread_count + 1) + 1024);
+		}
+	}
+
+	void submit(size_t depth) {
+		clock_type_t::time_point queued = clock_type_t::now();
+		worker.queue([this, queued, depth]() {
+			execute(queued, depth);
+		});
+	}
+
+	void execute(clock_type_t::time_point queued, size_t depth) {
+		clock_type_t::time_point started = clock_type_t::now();
+		size_t index = worker.get_current_thread_index();
+		samples[index < config.thread_count ? index : config.thread_count].emplace_back(std::chrono::duration_cast<std::chrono::nanoseconds>(started - queued).count());
+
+		volatile size_t sink = 0;
+		for (size_t i = 0; i < config.work_spin; i++) {
+			sink = sink + i;
+		}
+
+		if (depth < config.chain_length) {
+			submit(depth + 1);
+		} else {
+			completed.fetch_add(1, std::memory_order_release);
+		}
+	}
+
+	void run(const char* name) {
+		worker.start();
+		clock_type_t::time_point begin = clock_type_t::now();
+
+		// external submitter, keeps at most in_flight root tasks running
+		for (size_t i = 0; i < config.task_count; i++) {
+			while (i - completed.load(std::memory_order_acquire) >= config.in_flight) {
+				std::this_thread::yield();
+			}
+
+			submit(0);
+		}
+
+		while (completed.load(std::memory_order_acquire) != config.task_count) {
+			std::this_thread::yield();
+		}
+
+		double seconds = std::chrono::duration<double>(clock_type_t::now() - begin).count();
+		worker.terminate();
+		worker.join();
+
+		std::vector<int64_t> all;
+		for (auto& s : samples) {
+			all.insert(all.end(), s.begin(), s.end());
+		}
+
+		std::sort(all.begin(), all.end());
+		auto percentile = [&all](double ratio) {
+			return all.empty() ? 0.0 : all[std::min(all.size() - 1, size_t(ratio * all.size()))] / 1000.0;
+		};
+
+		printf("%-14s threads=%zu tasks=%zu tasks/s=%.0f queue(us) p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n", name, config.thread_count, all.size(), all.size() / seconds,
+			percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), all.empty() ? 0.0 : all.back() / 1000.0);
+	}
+
+	const bench_config_t& config;
+	worker_t worker;
+	std::vector<std::vector<int64_t>> samples; // indexed by thread, the last one is for the submitter
+	std::atomic<size_t> completed;
+};
+
+int main(int argc, char* argv[]) {
+	bench_config_t config;
+	std::vector<size_t> thread_counts;
+	if (argc > 1) config.task_count = strtoul(argv[1], nullptr, 10);
+	if (argc > 2) config.chain_length = strtoul(argv[2], nullptr, 10);
+	for (int i = 3; i < argc; i++) {
+		thread_counts.emplace_back(strtoul(argv[i], nullptr, 10));
+	}
+
+	if (thread_counts.empty()) {
+		thread_counts = { 1, 2, 4 };
+	}
+
+	for (size_t thread_count : thread_counts) {
+		config.thread_count = thread_count;
+		bench_runner_t<iris_async_worker_t<>>(config).run("stack");
+		bench_runner_t<iris_async_worker_t<std::thread, std::function<void()>, iris_default_object_allocator_t, 4, 4, true>>(config).run("work_stealing");
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,370 @@
+/*
+ngx_mock_host.cpp
+
+The MIT License (MIT)
+
+Copyright (c) 2025-2026 PaintDream
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+// A tiny fake OpenResty host for benchmarking the yield/resume bridge of ngx_lua_cpp outside nginx.
+// It exports the nginx symbols that ngx_hooker_t looks up, emulates ngx.sleep(0) with ngx_posted_delayed_events,
+// and drives many lua coroutines calling inst:sleep(0) through a minimal event loop.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+
+extern "C" {
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+}
+
+#define NGX_MOCK_API __attribute__ ((visibility ("default")))
+
+extern "C" int luaopen_ngx_lua_cpp(lua_State* L);
+
+using ngx_int_t = intptr_t;
+using ngx_uint_t = uintptr_t;
+using ngx_msec_t = uintptr_t;
+using ngx_event_handler_pt = void (*)(void* ev);
+using ngx_cleanup_pt = void (*)(void* data);
+
+struct ngx_queue_t {
+	ngx_queue_t* prev;
+	ngx_queue_t* next;
+};
+
+struct ngx_event_actions_t {
+	ngx_int_t (*add)(void* ev, ngx_int_t event, ngx_uint_t flags);
+	ngx_int_t (*del)(void* ev, ngx_int_t event, ngx_uint_t flags);
+	ngx_int_t (*enable)(void* ev, ngx_int_t event, ngx_uint_t flags);
+	ngx_int_t (*disable)(void* ev, ngx_int_t event, ngx_uint_t flags);
+	ngx_int_t (*add_conn)(void* c);
+	ngx_int_t (*del_conn)(void* c, ngx_uint_t flags);
+	ngx_int_t (*notify)(ngx_event_handler_pt handler);
+	ngx_int_t (*process_events)(void* cycle, ngx_msec_t timer, ngx_uint_t flags);
+	ngx_int_t (*init)(void* cycle, ngx_msec_t timer);
+	void (*done)(void* cycle);
+};
+
+struct ngx_module_t {
+	ngx_uint_t ctx_index;
+};
+
+struct ngx_http_request_t {
+	uint32_t signature;
+	void* connection;
+	void** ctx;
+};
+
+// same leading fields as ngx_http_lua_co_ctx_t, the offset of the sleep event is probed by ngx_lua_cpp
+struct mock_co_ctx_t {
+	void* data;
+	lua_State* co;
+	mock_co_ctx_t* parent_co_ctx;
+	void* zombie_child_threads;
+	void** next_zombie_child_thread;
+	ngx_cleanup_pt cleanup;
+	ngx_queue_t sleep_queue;
+	bool sleep_posted;
+	int thread_ref;
+};
+
+static ngx_int_t mock_process_events(void* cycle, ngx_msec_t timer, ngx_uint_t flags);
+
+extern "C" {
+	NGX_MOCK_API ngx_event_actions_t ngx_event_actions = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, &mock_process_events, nullptr, nullptr };
+	NGX_MOCK_API ngx_queue_t ngx_posted_delayed_events = { &ngx_posted_delayed_events, &ngx_posted_delayed_events };
+	NGX_MOCK_API ngx_module_t ngx_http_lua_module = { 0 };
+	NGX_MOCK_API void* lua_getexdata(lua_State* L);
+	NGX_MOCK_API void* ngx_http_lua_get_co_ctx(lua_State* L, void* ctx);
+	NGX_MOCK_API ngx_int_t ngx_add_channel_event(void* cycle, int fd, ngx_int_t event, ngx_event_handler_pt handler);
+}
+
+struct mock_host_t {
+	std::unordered_map<lua_State*, mock_co_ctx_t*> co_ctxs;
+	std::vector<std::unique_ptr<mock_co_ctx_t>> co_ctx_storage;
+	std::vector<double> latencies; // microseconds
+	void* lua_ctx_slots[1] = { &lua_ctx_slots };
+	ngx_http_request_t request = { 0, nullptr, lua_ctx_slots };
+	int channel_fd = -1;
+	ngx_event_handler_pt channel_handler = nullptr;
+	size_t finished = 0;
+};
+
+static mock_host_t host;
+
+void* lua_getexdata(lua_State* L) {
+	// every registered coroutine belongs to the same fake request
+	return host.co_ctxs.count(L) != 0 ? &host.request : nullptr;
+}
+
+void* ngx_http_lua_get_co_ctx(lua_State* L, void*) {
+	auto it = host.co_ctxs.find(L);
+	return it != host.co_ctxs.end() ? it->second : nullptr;
+}
+
+ngx_int_t ngx_add_channel_event(void*, int fd, ngx_int_t, ngx_event_handler_pt handler) {
+	host.channel_fd = fd;
+	host.channel_handler = handler;
+	return 0;
+}
+
+static void ngx_queue_insert_tail(ngx_queue_t* h, ngx_queue_t* x) {
+	x->prev = h->prev;
+	x->prev->next = x;
+	x->next = h;
+	h->prev = x;
+}
+
+static void ngx_queue_remove(ngx_queue_t* x) {
+	x->next->prev = x->prev;
+	x->prev->next = x->next;
+}
+
+static ngx_int_t mock_process_events(void*, ngx_msec_t timer, ngx_uint_t) {
+	int timeout = timer == ~ngx_msec_t(0) ? 100 : static_cast<int>(std::min(timer, ngx_msec_t(100u)));
+	if (host.channel_fd == -1) {
+		::poll(nullptr, 0, timeout);
+		return 0;
+	}
+
+	struct pollfd fd = { host.channel_fd, POLLIN, 0 };
+	if (::poll(&fd, 1, timeout) > 0 && host.channel_handler != nullptr) {
+		host.channel_handler(nullptr);
+	}
+
+	return 0;
+}
+
+static void mock_sleep_cleanup(void* data) {
+	mock_co_ctx_t* co_ctx = static_cast<mock_co_ctx_t*>(data);
+	if (co_ctx->sleep_posted) {
+		ngx_queue_remove(&co_ctx->sleep_queue);
+		co_ctx->sleep_posted = false;
+	}
+}
+
+// ngx.sleep(0): install cleanup, post the sleep event and yield
+static int mock_sleep(lua_State* L) {
+	auto it = host.co_ctxs.find(L);
+	if (it == host.co_ctxs.end()) {
+		return luaL_error(L, "no request found");
+	}
+
+	mock_co_ctx_t* co_ctx = it->second;
+	co_ctx->cleanup = &mock_sleep_cleanup;
+	if (!co_ctx->sleep_posted) {
+		co_ctx->sleep_posted = true;
+		ngx_queue_insert_tail(&ngx_posted_delayed_events, &co_ctx->sleep_queue);
+	}
+
+	return lua_yield(L, 0);
+}
+
+static double now_microseconds() {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int bench_now(lua_State* L) {
+	lua_pushnumber(L, now_microseconds());
+	return 1;
+}
+
+static int bench_record(lua_State* L) {
+	host.latencies.emplace_back(lua_tonumber(L, 1));
+	return 0;
+}
+
+static void resume_coroutine(lua_State* L, mock_co_ctx_t* co_ctx, int narg) {
+	int status = lua_resume(co_ctx->co, narg);
+	if (status != LUA_YIELD) {
+		if (status != 0) {
+			fprintf(stderr, "coroutine error: %s\n", lua_tostring(co_ctx->co, -1));
+		}
+
+		host.co_ctxs.erase(co_ctx->co);
+		luaL_unref(L, LUA_REGISTRYINDEX, co_ctx->thread_ref);
+		host.finished++;
+	}
+}
+
+// the ngx_event_process_posted() part
+static void process_posted_events(lua_State* L) {
+	while (ngx_posted_delayed_events.next != &ngx_posted_delayed_events) {
+		ngx_queue_t* q = ngx_posted_delayed_events.next;
+		ngx_queue_remove(q);
+		mock_co_ctx_t* co_ctx = reinterpret_cast<mock_co_ctx_t*>(reinterpret_cast<uint8_t*>(q) - offsetof(mock_co_ctx_t, sleep_queue));
+		co_ctx->sleep_posted = false;
+		co_ctx->cleanup = nullptr;
+		resume_coroutine(L, co_ctx, 0);
+	}
+}
+
+static const char bench_script[] =
+	"local inst, iterations = ...\n"
+	"local now, record = bench.now, bench.record\n"
+	"for i = 1, iterations do\n"
+	"	local start = now()\n"
+	"	inst:sleep(0)\n"
+	"	record(now() - start)\n"
+	"end\n";
+
+static double percentile(const std::vector<double>& sorted, double ratio) {
+	if (sorted.empty()) {
+		return 0.0;
+	}
+
+	size_t index = std::min(sorted.size() - 1, static_cast<size_t>(ratio * static_cast<double>(sorted.size())));
+	return sorted[index];
+}
+
+static bool run_round(lua_State* L, int script_ref, size_t thread_count, size_t coroutine_count, size_t iterations) {
+	lua_getglobal(L, "ngx_lua_cpp");
+	lua_getfield(L, -1, "new");
+	if (lua_pcall(L, 0, 1, 0) != 0) {
+		fprintf(stderr, "ngx_lua_cpp.new() failed: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 2);
+		return false;
+	}
+
+	lua_getfield(L, -1, "start");
+	lua_pushvalue(L, -2);
+	lua_pushinteger(L, static_cast<lua_Integer>(thread_count));
+	if (lua_pcall(L, 2, 0, 0) != 0) {
+		fprintf(stderr, "inst:start() failed: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 3);
+		return false;
+	}
+
+	int inst_index = lua_gettop(L);
+	host.latencies.clear();
+	host.latencies.reserve(coroutine_count * iterations);
+	host.co_ctx_storage.clear();
+	host.finished = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < coroutine_count; i++) {
+		auto co_ctx = std::make_unique<mock_co_ctx_t>();
+		co_ctx->co = lua_newthread(L);
+		co_ctx->thread_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		co_ctx->data = co_ctx.get();
+		host.co_ctxs[co_ctx->co] = co_ctx.get();
+
+		lua_State* co = co_ctx->co;
+		lua_rawgeti(co, LUA_REGISTRYINDEX, script_ref);
+		lua_pushvalue(L, inst_index);
+		lua_xmove(L, co, 1);
+		lua_pushinteger(co, static_cast<lua_Integer>(iterations));
+
+		mock_co_ctx_t* p = co_ctx.get();
+		host.co_ctx_storage.emplace_back(std::move(co_ctx));
+		resume_coroutine(L, p, 2);
+	}
+
+	while (host.finished < coroutine_count) {
+		ngx_event_actions.process_events(nullptr, 100, 0);
+		process_posted_events(L);
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	lua_getfield(L, inst_index, "stop");
+	lua_pushvalue(L, inst_index);
+	lua_pcall(L, 1, 0, 0);
+	lua_settop(L, inst_index - 2);
+	lua_gc(L, LUA_GCCOLLECT, 0);
+
+	std::vector<double>& sorted = host.latencies;
+	std::sort(sorted.begin(), sorted.end());
+	printf("threads=%zu coroutines=%zu calls=%zu calls/s=%.0f p50=%.1fus p90=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus\n",
+		thread_count, coroutine_count, sorted.size(), static_cast<double>(sorted.size()) / seconds,
+		percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99), percentile(sorted, 0.999),
+		sorted.empty() ? 0.0 : sorted.back());
+
+	return true;
+}
+
+// usage: ngx_lua_cpp_bench_bridge [coroutines] [iterations] [thread counts...]
+int main(int argc, char* argv[]) {
+	size_t coroutine_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000;
+	size_t iterations = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100;
+	std::vector<size_t> thread_counts;
+	for (int i = 3; i < argc; i++) {
+		thread_counts.emplace_back(strtoul(argv[i], nullptr, 10));
+	}
+
+	if (thread_counts.empty()) {
+		thread_counts = { 0, 1, 2, 4 };
+	}
+
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	// ngx = { config = { subsystem = "http" }, sleep = mock_sleep }
+	lua_newtable(L);
+	lua_newtable(L);
+	lua_pushstring(L, "http");
+	lua_setfield(L, -2, "subsystem");
+	lua_setfield(L, -2, "config");
+	lua_pushcfunction(L, &mock_sleep);
+	lua_setfield(L, -2, "sleep");
+	lua_setglobal(L, "ngx");
+
+	lua_newtable(L);
+	lua_pushcfunction(L, &bench_now);
+	lua_setfield(L, -2, "now");
+	lua_pushcfunction(L, &bench_record);
+	lua_setfield(L, -2, "record");
+	lua_setglobal(L, "bench");
+
+	lua_pushcfunction(L, &luaopen_ngx_lua_cpp);
+	if (lua_pcall(L, 0, 1, 0) != 0) {
+		fprintf(stderr, "luaopen_ngx_lua_cpp() failed: %s\n", lua_tostring(L, -1));
+		return EXIT_FAILURE;
+	}
+
+	lua_setglobal(L, "ngx_lua_cpp");
+
+	if (luaL_loadbuffer(L, bench_script, sizeof(bench_script) - 1, "=(bench)") != 0) {
+		fprintf(stderr, "%s\n", lua_tostring(L, -1));
+		return EXIT_FAILURE;
+	}
+
+	int script_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	for (size_t thread_count : thread_counts) {
+		if (!run_round(L, script_ref, thread_count, coroutine_count, iterations)) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	luaL_unref(L, LUA_REGISTRYINDEX, script_ref);
+	lua_close(L);
+	return EXIT_SUCCESS;
+}
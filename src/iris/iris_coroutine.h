@@ -33,10 +33,232 @@ SOFTWARE.
 
 // C++20 coroutine support
 #include <coroutine>
+#include <deque>
 
 namespace iris {
+	// cancellation flag shared between a coroutine chain and its owner.
+	// the owner must keep the token alive until the coroutine completes. cancel() may be called from any thread.
+	struct iris_cancel_token_t {
+		iris_cancel_token_t() noexcept {
+			cancelled.store(false, std::memory_order_relaxed);
+		}
+
+		// an awaiter parked on the token, woken up early by cancel(), see iris_delay_t
+		struct waiter_t {
+			virtual void wake() noexcept = 0;
+		};
+
+		void cancel() noexcept {
+			cancelled.store(true, std::memory_order_release);
+
+			// wake() runs under the lock, so the waiter can not be resumed and destroyed meanwhile
+			std::lock_guard<std::mutex> guard(waiter_mutex);
+			if (waiter != nullptr) {
+				std::exchange(waiter, nullptr)->wake();
+			}
+		}
+
+		// register a waiter, park() runs under the lock so it completes before any wake().
+		// returns false without parking if the token is cancelled already
+		template <typename park_t>
+		bool park(waiter_t* w, park_t&& p) {
+			std::lock_guard<std::mutex> guard(waiter_mutex);
+			if (is_cancelled()) {
+				return false;
+			}
+
+			IRIS_ASSERT(waiter == nullptr);
+			p();
+			waiter = w;
+			return true;
+		}
+
+		// unregister a waiter before resuming it
+		void unpark(waiter_t* w) noexcept {
+			std::lock_guard<std::mutex> guard(waiter_mutex);
+			if (waiter == w) {
+				waiter = nullptr;
+			}
+		}
+
+		// cancelled explicitly or expired
+		bool is_cancelled() const noexcept {
+			return cancelled.load(std::memory_order_acquire) || is_expired();
+		}
+
+		bool is_expired() const noexcept {
+			return deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= deadline;
+		}
+
+		// mark that work of the chain was skipped for the cancellation (a routine, a wait, or a check of iris_cancelled()).
+		// a cancelled chain may still have completed all its work, tell it by is_skipped()
+		void skip() noexcept {
+			skipped.store(true, std::memory_order_release);
+		}
+
+		bool is_skipped() const noexcept {
+			return skipped.load(std::memory_order_acquire);
+		}
+
+		// the token expires at deadline, pool tasks of the chain are picked in earliest deadline first order.
+		// only valid when no coroutine references this token
+		void set_deadline(std::chrono::steady_clock::time_point time_point) noexcept {
+			deadline = time_point;
+		}
+
+		std::chrono::steady_clock::time_point get_deadline() const noexcept {
+			return deadline;
+		}
+
+		// admission of pool tasks queued by the chain, see impl::queue_with_token()
+		struct gate_t {
+			// call dispatch() once the task is admitted, it queues the task to the pool
+			virtual void enter(std::function<void()>&& dispatch) = 0;
+			// an admitted task returned after running for busy_time
+			virtual void leave(std::chrono::steady_clock::duration busy_time) noexcept = 0;
+		};
+
+		// only valid when no coroutine references this token
+		void set_gate(gate_t* g) noexcept {
+			gate = g;
+		}
+
+		gate_t* get_gate() const noexcept {
+			return gate;
+		}
+
+		// mark the chain as started, only the first mark counts. called by pool tasks queued with the token,
+		// and by iris_switch() resuming the chain on a thread of the worker
+		void start() noexcept {
+			if (started.load(std::memory_order_relaxed) == 0) {
+				std::chrono::steady_clock::rep expected = 0;
+				started.compare_exchange_strong(expected, std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_release, std::memory_order_relaxed);
+			}
+		}
+
+		// time point of the first start(), or a zero time point if the chain never started
+		std::chrono::steady_clock::time_point get_started() const noexcept {
+			return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(started.load(std::memory_order_acquire)));
+		}
+
+		// only valid when no coroutine references this token
+		void reset() noexcept {
+			cancelled.store(false, std::memory_order_relaxed);
+			skipped.store(false, std::memory_order_relaxed);
+			started.store(0, std::memory_order_relaxed);
+			deadline = std::chrono::steady_clock::time_point::max();
+			gate = nullptr;
+		}
+
+		// token picked up by coroutines created on current thread, set it around the creation of a top-level coroutine
+		static iris_cancel_token_t*& get_current() noexcept {
+			return iris_static_instance_t<iris_cancel_token_t*>::get_thread_local();
+		}
+
+	protected:
+		std::atomic<bool> cancelled;
+		std::atomic<bool> skipped = false;
+		std::atomic<std::chrono::steady_clock::rep> started = 0;
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		gate_t* gate = nullptr;
+		std::mutex waiter_mutex;
+		waiter_t* waiter = nullptr;
+	};
+
+	// priority of pool tasks queued by a coroutine chain, see iris_switch()
+	struct iris_priority_t {
+		// picked up by coroutines created on current thread, ~size_t(0) means inheriting it from the awaiting parent
+		static size_t& get_current() noexcept {
+			return iris_static_instance_t<iris_priority_t>::get_thread_local().value;
+		}
+
+		size_t value = ~size_t(0);
+	};
+
 	// standard coroutine interface settings
 	namespace impl {
+		template <typename promise_t, typename = void>
+		struct has_cancel_token : std::false_type {};
+
+		template <typename promise_t>
+		struct has_cancel_token<promise_t, iris_void_t<decltype(std::declval<promise_t>().cancel_token)>> : std::true_type {};
+
+		template <typename promise_t>
+		iris_cancel_token_t* get_cancel_token(std::coroutine_handle<promise_t>& handle) noexcept {
+			if constexpr (has_cancel_token<promise_t>::value) {
+				return handle.promise().cancel_token;
+			} else {
+				return nullptr;
+			}
+		}
+
+		// dispatch(task) queues the task to the pool. with a gate on the token, it is called once admitted and the task leaves the gate when it returns.
+		// the token may be reused once the chain completes, nothing of it is kept after the task
+		template <typename callable_t, typename dispatch_t>
+		void dispatch_with_gate(iris_cancel_token_t* token, callable_t&& callable, dispatch_t&& dispatch) {
+			iris_cancel_token_t::gate_t* gate = token != nullptr ? token->get_gate() : nullptr;
+			if (gate == nullptr) {
+				dispatch(std::forward<callable_t>(callable));
+				return;
+			}
+
+			auto task = [gate, callable = std::forward<callable_t>(callable)]() mutable {
+				auto start = std::chrono::steady_clock::now();
+				callable();
+				gate->leave(std::chrono::steady_clock::now() - start);
+			};
+
+			gate->enter([dispatch = std::forward<dispatch_t>(dispatch), task = std::move(task)]() mutable {
+				dispatch(std::move(task));
+			});
+		}
+
+		// queue to the pool, earliest deadline first if the token has a deadline. the token is started when the task runs
+		template <typename async_worker_t, typename callable_t>
+		void queue_with_token(async_worker_t& async_worker, iris_cancel_token_t* token, callable_t&& callable, size_t priority) {
+			if (token == nullptr) {
+				async_worker.queue(std::forward<callable_t>(callable), priority);
+				return;
+			}
+
+			auto task = [token, callable = std::forward<callable_t>(callable)]() mutable {
+				token->start();
+				callable();
+			};
+
+			dispatch_with_gate(token, std::move(task), [&async_worker, deadline = token->get_deadline(), priority](auto&& task) {
+				if (deadline != std::chrono::steady_clock::time_point::max()) {
+					async_worker.queue_deadline(std::forward<decltype(task)>(task), deadline, priority);
+				} else {
+					async_worker.queue(std::forward<decltype(task)>(task), priority);
+				}
+			});
+		}
+
+		template <typename promise_t, typename = void>
+		struct has_priority : std::false_type {};
+
+		template <typename promise_t>
+		struct has_priority<promise_t, iris_void_t<decltype(std::declval<promise_t>().priority)>> : std::true_type {};
+
+		template <typename promise_t>
+		size_t get_priority(std::coroutine_handle<promise_t>& handle) noexcept {
+			if constexpr (has_priority<promise_t>::value) {
+				return handle.promise().priority;
+			} else {
+				return ~size_t(0);
+			}
+		}
+
+		// the token of a completing coroutine is current in its completion handler, so owners could tell which chain completes.
+		// kept if the handler has changed it
+		inline void restore_cancel_token(iris_cancel_token_t* token, iris_cancel_token_t* prev) noexcept {
+			iris_cancel_token_t*& current = iris_cancel_token_t::get_current();
+			if (current == token) {
+				current = prev;
+			}
+		}
+
 		template <typename return_t, template <typename...> class function_t>
 		struct promise_type_base {
 			constexpr std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
@@ -46,13 +268,17 @@ namespace iris {
 			// notice that value must be a rvalue and this completion is happened before destruction of living local variables in coroutine body
 			void return_value(return_t&& value) noexcept {
 				if (completion) {
+					iris_cancel_token_t* prev = std::exchange(iris_cancel_token_t::get_current(), cancel_token);
 					completion(std::coroutine_handle<decltype(*this)>::from_promise(*this).address(), std::move(value));
+					restore_cancel_token(cancel_token, prev);
 				}
 			}
 
 			// currently we do not handle unexcepted exceptions
 			void unhandled_exception() noexcept { return std::terminate(); }
 			function_t<void(void*, return_t&&)> completion;
+			iris_cancel_token_t* cancel_token = iris_cancel_token_t::get_current();
+			size_t priority = iris_priority_t::get_current();
 		};
 
 		template <template <typename...> class function_t>
@@ -62,12 +288,16 @@ namespace iris {
 
 			void return_void() noexcept {
 				if (completion) {
+					iris_cancel_token_t* prev = std::exchange(iris_cancel_token_t::get_current(), cancel_token);
 					completion(std::coroutine_handle<decltype(*this)>::from_promise(*this).address());
+					restore_cancel_token(cancel_token, prev);
 				}
 			}
 
 			void unhandled_exception() noexcept { return std::terminate(); }
 			function_t<void(void*)> completion;
+			iris_cancel_token_t* cancel_token = iris_cancel_token_t::get_current();
+			size_t priority = iris_priority_t::get_current();
 		};
 	}
 
@@ -154,6 +384,14 @@ namespace iris {
 			});
 		}
 
+		// bind a cancel token explicitly, must be called before run()
+		iris_coroutine_t& cancel_with(iris_cancel_token_t* token) noexcept {
+			IRIS_ASSERT(handle);
+			handle.promise().cancel_token = token;
+
+			return *this;
+		}
+
 		// run coroutine intermediately
 		void run() noexcept(noexcept(std::declval<std::coroutine_handle<promise_type>>().resume())) {
 			IRIS_ASSERT(handle);
@@ -167,15 +405,24 @@ namespace iris {
 			return false;
 		}
 
-		// chain execution
-		void await_suspend(std::coroutine_handle<> parent_handle) {
+		// chain execution, child inherits the cancel token and priority of parent if it has none
+		template <typename parent_promise_t>
+		void await_suspend(std::coroutine_handle<parent_promise_t> parent_handle) {
+			if (handle.promise().cancel_token == nullptr) {
+				handle.promise().cancel_token = impl::get_cancel_token(parent_handle);
+			}
+
+			if (handle.promise().priority == ~size_t(0)) {
+				handle.promise().priority = impl::get_priority(parent_handle);
+			}
+
 			if constexpr (!std::is_void_v<return_t>) {
-				complete([this, parent_handle = std::move(parent_handle)](void*, return_t&& value) mutable noexcept(noexcept(std::declval<std::coroutine_handle<>>().resume())) {
+				complete([this, parent_handle = std::coroutine_handle<>(parent_handle)](void*, return_t&& value) mutable noexcept(noexcept(std::declval<std::coroutine_handle<>>().resume())) {
 					await_result = &value;
 					parent_handle.resume();
 				});
 			} else {
-				complete([this, parent_handle = std::move(parent_handle)](void*) mutable noexcept(noexcept(std::declval<std::coroutine_handle<>>().resume())) {
+				complete([this, parent_handle = std::coroutine_handle<>(parent_handle)](void*) mutable noexcept(noexcept(std::declval<std::coroutine_handle<>>().resume())) {
 					parent_handle.resume();
 				});
 			}
@@ -274,11 +521,7 @@ namespace iris {
 			// the same warp, execute at once!
 			// even they are both null
 			if (target == caller) {
-				if constexpr (std::is_void_v<return_t>) {
-					func();
-				} else {
-					ret = func(); // auto moved here
-				}
+				invoke();
 
 				status.fetch_or(status_mask_completed, std::memory_order_release);
 				if (resume_handle != std::coroutine_handle()) {
@@ -287,27 +530,19 @@ namespace iris {
 			} else {
 				if (target == nullptr) {
 					// targeting to thread pool with no warp context
-					caller->get_async_worker().queue([this]() mutable {
-						if constexpr (std::is_void_v<return_t>) {
-							func();
-						} else {
-							ret = func();
-						}
+					impl::queue_with_token(caller->get_async_worker(), cancel_token, [this]() mutable {
+						invoke();
 
 						if (status.fetch_or(status_mask_completed, std::memory_order_release) & status_mask_waited) {
 							resume_one();
 						}
-					});
+					}, 0);
 				} else {
 					if (parallel_priority == ~size_t(0)) {
 						// targeting to a valid warp
 						// prepare callback first
 						auto callback = [this]() mutable noexcept(noexcept(func()) && noexcept(std::declval<iris_awaitable_t>().resume_one())) {
-							if constexpr (std::is_void_v<return_t>) {
-								func();
-							} else {
-								ret = func();
-							}
+							invoke();
 
 							if (status.fetch_or(status_mask_completed, std::memory_order_release) & status_mask_waited) {
 								resume_one();
@@ -321,13 +556,9 @@ namespace iris {
 
 						// let async_worker running them, so multiple routines around the same target could be executed in parallel
 						typename warp_t::suspend_guard_t guard(target);
-						target->get_async_worker().queue([this]() mutable noexcept(noexcept(func()) && noexcept(std::declval<iris_awaitable_t>().resume_one()) && noexcept(target->resume())) {
+						impl::queue_with_token(target->get_async_worker(), cancel_token, [this]() mutable noexcept(noexcept(func()) && noexcept(std::declval<iris_awaitable_t>().resume_one()) && noexcept(target->resume())) {
 							typename warp_t::suspend_guard_t guard(target);
-							if constexpr (std::is_void_v<return_t>) {
-								func();
-							} else {
-								ret = func();
-							}
+							invoke();
 
 							guard.cleanup();
 							target->resume();
@@ -345,8 +576,11 @@ namespace iris {
 			return true;
 		}
 
-		void await_suspend(std::coroutine_handle<> handle) {
-			resume_handle = std::move(handle);
+		// routines are skipped if the awaiting coroutine has been cancelled
+		template <typename promise_t>
+		void await_suspend(std::coroutine_handle<promise_t> handle) {
+			cancel_token = impl::get_cancel_token(handle);
+			resume_handle = std::coroutine_handle<>(handle);
 
 			if (status.fetch_or(status_mask_waited, std::memory_order_release) & status_mask_completed) {
 				resume_one();
@@ -362,6 +596,18 @@ namespace iris {
 		}
 
 	protected:
+		void invoke() {
+			if (cancel_token == nullptr || !cancel_token->is_cancelled()) {
+				if constexpr (std::is_void_v<return_t>) {
+					func();
+				} else {
+					ret = func(); // auto moved here
+				}
+			} else {
+				cancel_token->skip();
+			}
+		}
+
 		void resume_one() {
 			IRIS_ASSERT(resume_handle != std::coroutine_handle());
 
@@ -389,6 +635,7 @@ namespace iris {
 		size_t parallel_priority;
 		func_t func;
 		std::coroutine_handle<> resume_handle;
+		iris_cancel_token_t* cancel_token = nullptr;
 		std::conditional_t<std::is_void_v<return_t>, void_t, return_t> ret;
 	};
 
@@ -405,6 +652,188 @@ namespace iris {
 		return iris_awaitable_t<warp_t, std::decay_t<iris_func_t>>(target_warp, std::forward<iris_func_t>(func), priority);
 	}
 
+	// query cancellation of current coroutine without suspending:
+	// if (co_await iris_cancelled()) { ... }
+	struct iris_cancelled_t {
+		constexpr bool await_ready() const noexcept {
+			return false;
+		}
+
+		template <typename promise_t>
+		bool await_suspend(std::coroutine_handle<promise_t> handle) noexcept {
+			iris_cancel_token_t* token = impl::get_cancel_token(handle);
+			cancelled = token != nullptr && token->is_cancelled();
+			if (cancelled) {
+				// the caller is expected to stop its work
+				token->skip();
+			}
+
+			return false;
+		}
+
+		bool await_resume() const noexcept {
+			return cancelled;
+		}
+
+	protected:
+		bool cancelled = false;
+	};
+
+	inline iris_cancelled_t iris_cancelled() noexcept {
+		return iris_cancelled_t();
+	}
+
+	// wait for a duration without occupying any thread, the coroutine is parked in the timer wheel of async_worker.
+	// resumes on the warp where it was suspended, or on the thread pool if there is no warp context.
+	// a cancelled coroutine does not wait at all, cancel() takes the parked coroutine out of the wheel and resumes it early.
+	// the wait is cut at the deadline of the token too.
+	template <typename warp_t, typename duration_t>
+	struct iris_delay_t : iris_cancel_token_t::waiter_t {
+		using async_worker_t = typename warp_t::async_worker_t;
+		using task_base_t = typename async_worker_t::task_base_t;
+		iris_delay_t(async_worker_t& worker, duration_t d, size_t p) noexcept : async_worker(worker), duration(d), priority(p), caller(nullptr), token(nullptr), task(nullptr), expire(0) {}
+
+		bool await_ready() const noexcept {
+			return duration <= duration_t::zero();
+		}
+
+		template <typename promise_t>
+		bool await_suspend(std::coroutine_handle<promise_t> handle) {
+			token = impl::get_cancel_token(handle);
+			caller = warp_t::get_current();
+			if (token == nullptr) {
+				async_worker.queue_task_delayed(new_resume_task(handle), duration, priority);
+				return true;
+			}
+
+			std::chrono::steady_clock::duration wait = std::chrono::ceil<std::chrono::steady_clock::duration>(duration);
+			std::chrono::steady_clock::time_point deadline = token->get_deadline();
+			if (deadline != std::chrono::steady_clock::time_point::max()) {
+				wait = std::min(wait, deadline - std::chrono::steady_clock::now());
+			}
+
+			return token->park(this, [this, handle, wait]() {
+				task = new_resume_task(handle);
+				expire = async_worker.queue_task_delayed(task, wait, priority);
+			});
+		}
+
+		void await_resume() const noexcept {
+			// the wait was cut short or never happened
+			if (token != nullptr && token->is_cancelled()) {
+				token->skip();
+			}
+		}
+
+		// called by cancel(), the coroutine is not resumed until it returns
+		void wake() noexcept override {
+			if (async_worker.cancel_task_delayed(task, expire)) {
+				async_worker.queue_task(task, priority);
+			}
+		}
+
+	protected:
+		task_base_t* new_resume_task(std::coroutine_handle<> handle) {
+			return async_worker.new_task([this, handle]() mutable {
+				if (token != nullptr) {
+					token->unpark(this);
+				}
+
+				if (caller != nullptr) {
+					caller->queue_routine_post([handle]() mutable noexcept(noexcept(handle.resume())) {
+						handle.resume();
+					});
+				} else {
+					handle.resume();
+				}
+			});
+		}
+
+		async_worker_t& async_worker;
+		duration_t duration;
+		size_t priority;
+		warp_t* caller;
+		iris_cancel_token_t* token;
+		task_base_t* task;
+		uint64_t expire;
+	};
+
+	template <typename warp_t, typename rep_t, typename period_t>
+	auto iris_delay(typename warp_t::async_worker_t& async_worker, std::chrono::duration<rep_t, period_t> duration, size_t priority = 0) noexcept {
+		return iris_delay_t<warp_t, std::chrono::duration<rep_t, period_t>>(async_worker, duration, priority);
+	}
+
+	// time slice of the coroutine running on current thread, see iris_yield_if_exhausted()
+	struct iris_time_slice_t {
+		static iris_time_slice_t& get_current() noexcept {
+			return iris_static_instance_t<iris_time_slice_t>::get_thread_local();
+		}
+
+		void* owner = nullptr;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	// cooperative time slicing for long running coroutines.
+	// the slice starts at the first check after the coroutine is resumed on current thread, once budget is used up,
+	// the coroutine is requeued to the back of its warp, or behind other pool tasks of its priority (for at most budget)
+	template <typename warp_t, typename duration_t>
+	struct iris_yield_if_exhausted_t {
+		using async_worker_t = typename warp_t::async_worker_t;
+		iris_yield_if_exhausted_t(async_worker_t& worker, duration_t b) noexcept : async_worker(worker), budget(b) {}
+
+		bool await_ready() const noexcept {
+			return budget == duration_t::max();
+		}
+
+		template <typename promise_t>
+		bool await_suspend(std::coroutine_handle<promise_t> handle) {
+			iris_time_slice_t& slice = iris_time_slice_t::get_current();
+			auto now = std::chrono::steady_clock::now();
+			if (slice.owner != handle.address()) {
+				slice.owner = handle.address();
+				slice.start = now;
+				return false;
+			} else if (now - slice.start < budget) {
+				return false;
+			}
+
+			slice.owner = nullptr;
+			yielded = true;
+			warp_t* caller = warp_t::get_current();
+			if (caller != nullptr) {
+				caller->queue_routine_post([handle = std::coroutine_handle<>(handle)]() mutable noexcept(noexcept(handle.resume())) {
+					handle.resume();
+				});
+			} else {
+				size_t priority = impl::get_priority(handle);
+				auto resume_time = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget);
+				impl::dispatch_with_gate(impl::get_cancel_token(handle), [handle = std::coroutine_handle<>(handle)]() mutable noexcept(noexcept(handle.resume())) {
+					handle.resume();
+				}, [&worker = async_worker, resume_time, priority](auto&& task) {
+					worker.queue_yield(std::forward<decltype(task)>(task), resume_time, priority == ~size_t(0) ? 0 : priority);
+				});
+			}
+
+			return true;
+		}
+
+		// returns true if the coroutine was requeued
+		bool await_resume() const noexcept {
+			return yielded;
+		}
+
+	protected:
+		async_worker_t& async_worker;
+		duration_t budget;
+		bool yielded = false;
+	};
+
+	// co_await iris_yield_if_exhausted<warp_t>(worker, std::chrono::milliseconds(2)) in loops of long running work
+	template <typename warp_t, typename rep_t, typename period_t>
+	auto iris_yield_if_exhausted(typename warp_t::async_worker_t& async_worker, std::chrono::duration<rep_t, period_t> budget) noexcept {
+		return iris_yield_if_exhausted_t<warp_t, std::chrono::duration<rep_t, period_t>>(async_worker, budget);
+	}
+
 	// switch to specified warp or warp pair, and return the original current warp
 	template <typename warp_t>
 	struct iris_switch_t {
@@ -422,16 +851,25 @@ namespace iris {
 			}
 		}
 
+		// the chain is started the first time it is resumed on a thread of the worker, pool tasks are started by queue_with_token()
+		void resume(std::coroutine_handle<>& handle) {
+			if (token != nullptr && target != nullptr && target->get_async_worker().get_current_thread_index() != ~size_t(0)) {
+				token->start();
+			}
+
+			handle.resume();
+		}
+
 		void handler(std::coroutine_handle<>&& handle) {
 			// 1-1 mapping, just resume directly
 			if (other == nullptr) {
-				handle.resume();
+				resume(handle);
 				return;
 			} else if (parallel_other) {
 				other->suspend();
 				typename warp_t::suspend_guard_t guard(other);
 				if (!other->running()) {
-					handle.resume();
+					resume(handle);
 					return;
 				}
 			} else {
@@ -439,7 +877,7 @@ namespace iris {
 				typename warp_t::preempt_guard_t guard(*other, 0);
 				if (guard) {
 					// success, go resume directly
-					handle.resume();
+					resume(handle);
 					return;
 				}
 			}
@@ -459,23 +897,34 @@ namespace iris {
 			}
 		}
 
-		void await_suspend(std::coroutine_handle<> handle) {
+		template <typename promise_t>
+		void await_suspend(std::coroutine_handle<promise_t> promise_handle) {
+			std::coroutine_handle<> handle = promise_handle;
+			token = impl::get_cancel_token(promise_handle);
 			if (target == nullptr) {
 				std::swap(other, target);
 			}
 
 			if (target == nullptr) {
-				// full parallel dispatching
+				// full parallel dispatching, with the priority and deadline of the coroutine chain
 				IRIS_ASSERT(source != nullptr);
-				source->get_async_worker().queue([this, handle = std::move(handle)]() mutable {
+				size_t priority = impl::get_priority(promise_handle);
+				impl::queue_with_token(source->get_async_worker(), token, [this, handle = std::move(handle)]() mutable {
 					handler(std::move(handle));
-				});
+				}, priority == ~size_t(0) ? 0 : priority);
 			} else {
 				// dispatching under warp context
-				if (parallel_target && target->get_async_worker().get_current_thread_index() != ~size_t(0)) {
-					target->queue_routine_parallel([this, handle = std::move(handle)]() mutable {
-						handler(std::move(handle));
-					});
+				if (parallel_target) {
+					// run inline only on threads of the target worker
+					if (target->get_async_worker().get_current_thread_index() != ~size_t(0)) {
+						target->queue_routine_parallel([this, handle = std::move(handle)]() mutable {
+							handler(std::move(handle));
+						});
+					} else {
+						target->queue_routine_parallel_post([this, handle = std::move(handle)]() mutable {
+							handler(std::move(handle));
+						});
+					}
 				} else {
 					target->queue_routine_post([this, handle = std::move(handle)]() mutable {
 						handler(std::move(handle));
@@ -493,6 +942,7 @@ namespace iris {
 		warp_t* source;
 		warp_t* target;
 		warp_t* other;
+		iris_cancel_token_t* token = nullptr;
 		bool parallel_target;
 		bool parallel_other;
 	};
@@ -578,13 +1028,16 @@ namespace iris {
 		iris_sync_t(const iris_sync_t& rhs) = delete;
 		iris_sync_t& operator = (const iris_sync_t& rhs) = delete;
 
+		// token is optional, a coroutine resumed on the pool starts it (see iris_cancel_token_t::start())
 		struct info_base_warp_t {
 			std::coroutine_handle<> handle;
 			warp_t* warp = nullptr;
+			iris_cancel_token_t* token = nullptr;
 		};
 
 		struct info_base_t {
 			std::coroutine_handle<> handle;
+			iris_cancel_token_t* token = nullptr;
 		};
 
 		using info_t = std::conditional_t<std::is_same_v<warp_t, void>, info_base_t, info_base_warp_t>;
@@ -592,15 +1045,15 @@ namespace iris {
 		// dispatch coroutine based on warp status
 		void dispatch(info_t&& info) {
 			if constexpr (std::is_same_v<warp_t, void>) {
-				async_worker.queue([handle = std::move(info.handle)]() mutable noexcept(noexcept(info.handle.resume())) {
+				impl::queue_with_token(async_worker, info.token, [handle = std::move(info.handle)]() mutable noexcept(noexcept(info.handle.resume())) {
 					handle.resume();
-				});
+				}, 0);
 			} else {
 				warp_t* target = info.warp;
 				if (target == nullptr) {
-					async_worker.queue([handle = std::move(info.handle)]() mutable noexcept(noexcept(info.handle.resume())) {
+					impl::queue_with_token(async_worker, info.token, [handle = std::move(info.handle)]() mutable noexcept(noexcept(info.handle.resume())) {
 						handle.resume();
-					});
+					}, 0);
 				} else {
 					target->queue_routine_post([handle = std::move(info.handle)]() mutable noexcept(noexcept(info.handle.resume())) {
 						handle.resume();
@@ -1223,4 +1676,280 @@ namespace iris {
 		std::mutex lock;
 		iris_queue_list_t<std::pair<info_t, amount_t>> handles;
 	};
+
+	// get quota in coroutine, waiters of different tenants are woken by deficit round-robin
+	// each waiter costs 1, a tenant could wake up to `weight` waiters per round
+	template <typename quota_t, typename warp_t, typename async_worker_t = typename warp_t::async_worker_t>
+	struct iris_quota_fair_queue_t : iris_sync_t<warp_t, async_worker_t> {
+		iris_quota_fair_queue_t(async_worker_t& worker, quota_t& q) : iris_sync_t<warp_t, async_worker_t>(worker), quota(q) {}
+
+		using amount_t = typename quota_t::amount_t;
+		using info_t = typename iris_sync_t<warp_t, async_worker_t>::info_t;
+		using clock_t = std::chrono::steady_clock;
+
+		struct resource_t {
+			resource_t() noexcept : host(nullptr), tenant(0) {}
+			resource_t(iris_quota_fair_queue_t& q, size_t t, const amount_t& m) noexcept : host(&q), tenant(t), amount(m), start_time(clock_t::now()) {}
+			resource_t(const resource_t&) = delete;
+			resource_t(resource_t&& rhs) noexcept : host(rhs.host), tenant(rhs.tenant), amount(rhs.amount), start_time(rhs.start_time) { rhs.host = nullptr; }
+
+			resource_t& operator = (const resource_t&) = delete;
+			resource_t& operator = (resource_t&& rhs) noexcept {
+				if (this != &rhs) {
+					clear();
+
+					host = rhs.host;
+					tenant = rhs.tenant;
+					amount = rhs.amount;
+					start_time = rhs.start_time;
+					rhs.host = nullptr;
+				}
+
+				return *this;
+			}
+
+			~resource_t() noexcept {
+				clear();
+			}
+
+			void clear() noexcept {
+				if (host != nullptr) {
+					host->release(tenant, amount, clock_t::now() - start_time);
+					host = nullptr;
+				}
+			}
+
+			size_t get_tenant() const noexcept {
+				return tenant;
+			}
+
+			const amount_t& get_amount() const noexcept {
+				return amount;
+			}
+
+			iris_quota_fair_queue_t* get_queue() const noexcept {
+				return host;
+			}
+
+		protected:
+			iris_quota_fair_queue_t* host;
+			size_t tenant;
+			amount_t amount;
+			clock_t::time_point start_time;
+		};
+
+		struct awaitable_t {
+			awaitable_t(iris_quota_fair_queue_t& q, size_t t, const amount_t& m, bool r, bool p) noexcept : host(q), tenant(t), amount(m), ready(r), parallel(p) {}
+
+			bool await_ready() const noexcept {
+				return ready;
+			}
+
+			template <typename promise_t>
+			void await_suspend(std::coroutine_handle<promise_t> handle) {
+				info_t info;
+				info.token = impl::get_cancel_token(handle);
+				info.handle = std::move(handle);
+
+				if constexpr (!std::is_same_v<warp_t, void>) {
+					info.warp = parallel ? nullptr : warp_t::get_current();
+				}
+
+				host.acquire_queued(std::move(info), tenant, amount);
+			}
+
+			resource_t await_resume() noexcept {
+				return resource_t(host, tenant, amount);
+			}
+
+		protected:
+			iris_quota_fair_queue_t& host;
+			size_t tenant;
+			amount_t amount;
+			bool ready;
+			bool parallel;
+		};
+
+		struct statistics_t {
+			size_t weight = 0;
+			size_t queued_count = 0;
+			size_t running_count = 0;
+			size_t acquired_count = 0;
+			uint64_t busy_time = 0; // nanoseconds holding the quota
+		};
+
+		// tenants are never removed, returns the index for guard()
+		size_t add_tenant(size_t weight) {
+			std::lock_guard<std::mutex> guard(lock);
+			tenants.emplace_back().weight = std::max(weight, size_t(1));
+			return tenants.size() - 1;
+		}
+
+		void set_weight(size_t tenant, size_t weight) {
+			std::lock_guard<std::mutex> guard(lock);
+			IRIS_ASSERT(tenant < tenants.size());
+			tenants[tenant].weight = std::max(weight, size_t(1));
+		}
+
+		size_t get_tenant_count() const noexcept {
+			std::lock_guard<std::mutex> guard(lock);
+			return tenants.size();
+		}
+
+		statistics_t get_statistics(size_t tenant) const {
+			std::lock_guard<std::mutex> guard(lock);
+			IRIS_ASSERT(tenant < tenants.size());
+			const tenant_t& t = tenants[tenant];
+			statistics_t stats;
+			stats.weight = t.weight;
+			stats.queued_count = t.handles.size();
+			stats.running_count = t.running_count;
+			stats.acquired_count = t.acquired_count;
+			stats.busy_time = t.busy_time;
+			return stats;
+		}
+
+		// newcomers do not overtake queued waiters.
+		// if parallel, queued waiters are resumed on the worker instead of their warp, saving a hop for callers switching to the pool next
+		awaitable_t guard(size_t tenant, const amount_t& amount, bool parallel = false) {
+			return awaitable_t(*this, tenant, amount, queued_count.load(std::memory_order_acquire) == 0 && acquire(tenant, amount), parallel);
+		}
+
+		// run dispatch() once amount is acquired for tenant, e.g. to queue a task holding it (see iris_cancel_token_t::gate_t).
+		// the caller releases it with release()
+		void queue(size_t tenant, const amount_t& amount, std::function<void()>&& dispatch) {
+			if (queued_count.load(std::memory_order_acquire) == 0 && acquire(tenant, amount)) {
+				dispatch();
+			} else {
+				waiter_t waiter;
+				waiter.amount = amount;
+				waiter.dispatch = std::move(dispatch);
+				acquire_queued(std::move(waiter), tenant);
+			}
+		}
+
+		bool acquire(size_t tenant, const amount_t& amount) {
+			if (quota.acquire(amount)) {
+				std::lock_guard<std::mutex> guard(lock);
+				IRIS_ASSERT(tenant < tenants.size());
+				tenants[tenant].running_count++;
+				tenants[tenant].acquired_count++;
+				return true;
+			} else {
+				return false;
+			}
+		}
+
+		void release(size_t tenant, const amount_t& amount, clock_t::duration busy_time) {
+			quota.release(amount);
+
+			std::unique_lock<std::mutex> guard(lock);
+			tenant_t& t = tenants[tenant];
+			t.running_count--;
+			t.busy_time += std::chrono::duration_cast<std::chrono::nanoseconds>(busy_time).count();
+
+			while (!active.empty()) {
+				tenant_t& current = tenants[active.top()];
+				if (!current.in_turn) {
+					current.in_turn = true;
+					current.deficit += current.weight;
+				}
+
+				if (current.deficit == 0) {
+					// turn is over, go to the next tenant
+					current.in_turn = false;
+					size_t next = active.top();
+					active.pop();
+					active.push(std::move(next));
+					continue;
+				}
+
+				auto& top = current.handles.top();
+				if (!quota.acquire(top.amount)) {
+					break;
+				}
+
+				waiter_t h = std::move(top);
+				current.handles.pop();
+				current.deficit--;
+				current.running_count++;
+				current.acquired_count++;
+				queued_count.fetch_sub(1, std::memory_order_release);
+
+				if (current.handles.empty()) {
+					current.in_turn = false;
+					current.deficit = 0;
+					active.pop();
+				}
+
+				guard.unlock();
+				dispatch(std::move(h));
+				guard.lock();
+			}
+		}
+
+		amount_t get_amount() const noexcept {
+			return quota.get();
+		}
+
+	protected:
+		// a queued coroutine, or a dispatch function of queue()
+		struct waiter_t {
+			info_t info;
+			amount_t amount;
+			std::function<void()> dispatch;
+		};
+
+		void acquire_queued(info_t&& info, size_t tenant, const amount_t& amount) {
+			waiter_t waiter;
+			waiter.info = std::move(info);
+			waiter.amount = amount;
+			acquire_queued(std::move(waiter), tenant);
+		}
+
+		void acquire_queued(waiter_t&& waiter, size_t tenant) {
+			std::unique_lock<std::mutex> guard(lock);
+			IRIS_ASSERT(tenant < tenants.size());
+			tenant_t& t = tenants[tenant];
+			// retry: see iris_quota_queue_t::acquire_queued
+			if (queued_count.load(std::memory_order_acquire) == 0 && quota.acquire(waiter.amount)) {
+				t.running_count++;
+				t.acquired_count++;
+				guard.unlock();
+				dispatch(std::move(waiter));
+				return;
+			}
+
+			if (t.handles.empty()) {
+				active.push(tenant);
+			}
+
+			t.handles.push(std::move(waiter));
+			queued_count.fetch_add(1, std::memory_order_release);
+		}
+
+		void dispatch(waiter_t&& waiter) {
+			if (waiter.dispatch) {
+				waiter.dispatch();
+			} else {
+				iris_sync_t<warp_t, async_worker_t>::dispatch(std::move(waiter.info));
+			}
+		}
+
+		struct tenant_t {
+			size_t weight = 1;
+			size_t deficit = 0;
+			bool in_turn = false;
+			size_t running_count = 0;
+			size_t acquired_count = 0;
+			uint64_t busy_time = 0;
+			iris_queue_list_t<waiter_t> handles;
+		};
+
+		quota_t& quota;
+		mutable std::mutex lock;
+		std::atomic<size_t> queued_count = 0;
+		std::deque<tenant_t> tenants; // stable addresses on growth
+		iris_queue_list_t<size_t> active; // tenants with waiters in round-robin order
+	};
 }
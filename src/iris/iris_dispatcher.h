@@ -35,6 +35,14 @@ SOFTWARE.
 #include <mutex>
 #include <thread>
 #include <condition_variable>
+#include <chrono>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
 
 namespace iris {
 	namespace impl {	
@@ -176,6 +184,12 @@ namespace iris {
 		// moving capture is not supported until C++ 14
 		// so we wrap some functors here
 
+		struct unlimited_budget_t {
+			bool operator () () const noexcept {
+				return true;
+			}
+		};
+
 		struct execute_t {
 			execute_t(iris_warp_t& w) noexcept : warp(w) {}
 			void operator () () {
@@ -270,7 +284,7 @@ namespace iris {
 		// for warps, we prepare one queue for each thread to remove mutex requirements
 
 		template <bool s>
-		typename std::enable_if<s>::type init_storage(size_t thread_count) noexcept {}
+		typename std::enable_if<s>::type init_storage(size_t) noexcept {}
 
 		template <bool s>
 		typename std::enable_if<!s>::type init_storage(size_t thread_count) noexcept(noexcept(std::declval<iris_warp_t>().storage.queue_buffers.resize(thread_count))) {
@@ -347,6 +361,12 @@ namespace iris {
 			return storage.empty();
 		}
 
+		// nothing queued, executing or running in parallel. it could be destroyed if no one queues to it any more
+		bool is_idle() const noexcept {
+			return thread_warp.load(std::memory_order_acquire) == nullptr && suspend_count.load(std::memory_order_acquire) == 0
+				&& queueing.load(std::memory_order_acquire) == queue_state_t::idle && parallel_task_head.load(std::memory_order_acquire) == nullptr && storage.empty();
+		}
+
 		// yield execution atomically, returns true on success.
 		bool yield() noexcept(noexcept(std::declval<iris_warp_t>().flush())) {
 			iris_warp_t** exp = &get_current_internal();
@@ -417,6 +437,52 @@ namespace iris {
 			}
 		}
 
+		// send count tasks made by generator(i) to this warp with a single flush. always post them to queue.
+		template <typename generator_t>
+		void queue_routine_post_batch(size_t count, generator_t&& generator) {
+			if (count == 0) {
+				return;
+			}
+
+			if constexpr (strand) {
+				// link them in the same order as posting one by one, then publish with one cas
+				task_t* first = nullptr;
+				task_t* last = nullptr;
+				for (size_t i = 0; i < count; i++) {
+					task_t* task = async_worker.new_task(generator(i));
+					task->next = first;
+					first = task;
+					last = last == nullptr ? task : last;
+				}
+
+				task_t* node = storage.queueing_head.load(std::memory_order_relaxed);
+				do {
+					last->next = node;
+				} while (!storage.queueing_head.compare_exchange_weak(node, first, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+				flush();
+			} else {
+				size_t thread_index = async_worker.get_current_thread_index();
+				if (thread_index == ~size_t(0)) {
+					async_worker.queue_batch(count, [this, &generator](size_t i) {
+						return external_t<std::remove_reference_t<decltype(generator(i))>>(*this, generator(i));
+					}, priority);
+				} else {
+					std::vector<queue_buffer_t>& queue_buffers = storage.queue_buffers;
+					IRIS_ASSERT(thread_index < queue_buffers.size());
+					queue_buffer_t& buffer = queue_buffers[thread_index];
+					for (size_t i = 0; i < count; i++) {
+						auto func = generator(i);
+						buffer.push([this, &func](normal_task_t* storage) {
+							async_worker.construct_task_at(storage, std::move(func));
+						});
+					}
+
+					flush();
+				}
+			}
+		}
+
 		// queue task parallelly to async_worker
 		// it is useful to implement read-lock affairs about warp
 		template <typename callable_t>
@@ -513,6 +579,29 @@ namespace iris {
 			return poll<poll_async_worker>({ std::ref(*this) });
 		}
 
+		// execute tasks of this warp on current thread until budget() returns false after some task.
+		// returns true if there are tasks left (budget exhausted or warp busy).
+		template <typename budget_t>
+		bool poll_budget(budget_t&& budget) {
+			IRIS_PROFILE_SCOPE(__FUNCTION__);
+
+			suspend();
+			invoke_enter_join_warp<iris_warp_t>();
+
+			if (!empty() || has_parallel_task()) {
+				preempt_guard_t preempt_guard(*this, ~size_t(0));
+				if (preempt_guard) {
+					execute_parallel();
+					execute_internal<strand, true>(budget);
+				}
+			}
+
+			invoke_leave_join_warp<iris_warp_t>();
+			resume();
+
+			return !empty() || has_parallel_task();
+		}
+
 		// get current thread's warp binding instance
 		static iris_warp_t* get_current() noexcept {
 			return get_current_internal();
@@ -649,8 +738,8 @@ namespace iris {
 		}
 
 		// execute all tasks scheduled at once.
-		template <bool enable_strand, bool force>
-		typename std::enable_if<enable_strand>::type execute_internal() {
+		template <bool enable_strand, bool force, typename budget_t = unlimited_budget_t>
+		typename std::enable_if<enable_strand>::type execute_internal(budget_t&& budget = budget_t()) {
 			IRIS_PROFILE_SCOPE(__FUNCTION__);
 
 			// mark for queueing, avoiding flush me more than once.
@@ -682,7 +771,7 @@ namespace iris {
 					async_worker.execute_task(p);
 					execute_counter++;
 
-					if ((!force && is_suspended()) || *warp_ptr != this) {
+					if ((!force && is_suspended()) || *warp_ptr != this || !budget()) {
 						return;
 					}
 
@@ -692,8 +781,8 @@ namespace iris {
 			} while (execute_counter != 0);
 		}
 
-		template <bool enable_strand, bool force>
-		typename std::enable_if<!enable_strand>::type execute_internal() {
+		template <bool enable_strand, bool force, typename budget_t = unlimited_budget_t>
+		typename std::enable_if<!enable_strand>::type execute_internal(budget_t&& budget = budget_t()) {
 			IRIS_PROFILE_SCOPE(__FUNCTION__);
 
 			// mark for queueing, avoiding flush me more than once.
@@ -724,7 +813,7 @@ namespace iris {
 						execute_counter++;
 						counter = next_version;
 
-						if ((!force && is_suspended()) || *warp_ptr != this)
+						if ((!force && is_suspended()) || *warp_ptr != this || !budget())
 							return;
 					}
 
@@ -752,7 +841,12 @@ namespace iris {
 
 					if (!is_suspended()) { // double check for suspend_count
 						execute_internal<enable_strand, force>();
-						
+
+						// tasks left by a task suspending this warp, mark pending so yield() or resume() flushes them
+						if (get_current_internal() == this && !empty()) {
+							queueing.store(queue_state_t::pending, std::memory_order_relaxed);
+						}
+
 						bool preempted = preempt_guard.is_preempted();
 						preempt_guard.cleanup();
 						if (preempted && !yield()) {
@@ -1101,7 +1195,9 @@ namespace iris {
 
 	// here we code a trivial worker demo
 	// could be replaced by your implementation
-	template <typename thread_t = std::thread, typename large_callable_t = std::function<void()>, template <typename...> class allocator_t = iris_default_object_allocator_t, size_t default_task_duplicate_count = 4, size_t default_sub_allocator_count = 4>
+	// default_work_stealing selects the scheduler: LIFO task stacks (false), or per-thread FIFO work-stealing deques with global FIFO injection queues (true)
+	// default_padded_layout pads task heads and counters to cache lines (true), or packs them with a single task counter (false)
+	template <typename thread_t = std::thread, typename large_callable_t = std::function<void()>, template <typename...> class allocator_t = iris_default_object_allocator_t, size_t default_task_duplicate_count = 4, size_t default_sub_allocator_count = 4, bool default_work_stealing = false, bool default_padded_layout = true>
 	struct iris_async_worker_t {
 		// task wrapper
 		struct task_base_t {
@@ -1141,6 +1237,256 @@ namespace iris {
 
 		static constexpr size_t task_head_duplicate_count = default_task_duplicate_count;
 		static constexpr size_t sub_allocator_count = default_sub_allocator_count;
+		static constexpr bool work_stealing = default_work_stealing;
+		static constexpr bool padded_layout = default_padded_layout;
+		static constexpr size_t cache_line_size = padded_layout ? 64 : alignof(std::atomic<size_t>);
+		static constexpr size_t counter_shard_count = padded_layout ? 64 : 1;
+
+		// padded to a cache line, so neighbouring heads are not written by different threads in one line
+		struct alignas(cache_line_size) task_head_t {
+			std::atomic<task_base_t*> value;
+		};
+
+		struct alignas(cache_line_size) counter_shard_t {
+			std::atomic<size_t> value;
+		};
+
+		// bounded Chase-Lev deque without resizing. only the owner thread pushes at bottom,
+		// all threads (including the owner) take from top, so tasks are executed in FIFO order.
+		struct alignas(64) steal_deque_t {
+			static constexpr size_t capacity = 256;
+
+			steal_deque_t() noexcept {
+				top.store(0, std::memory_order_relaxed);
+				bottom.store(0, std::memory_order_relaxed);
+				for (size_t i = 0; i < capacity; i++) {
+					slots[i].store(nullptr, std::memory_order_relaxed);
+				}
+			}
+
+			// returns false if full
+			bool push(task_base_t* task) noexcept {
+				size_t b = bottom.load(std::memory_order_relaxed);
+				size_t t = top.load(std::memory_order_acquire);
+				if (b - t >= capacity) {
+					return false;
+				}
+
+				slots[b % capacity].store(task, std::memory_order_relaxed);
+				bottom.store(b + 1, std::memory_order_release);
+				return true;
+			}
+
+			task_base_t* steal() noexcept {
+				size_t t = top.load(std::memory_order_acquire);
+				while (true) {
+					size_t b = bottom.load(std::memory_order_acquire);
+					if (static_cast<ptrdiff_t>(b - t) <= 0) {
+						return nullptr;
+					}
+
+					// the slot can not be overwritten before top moves forward, which fails our cas
+					task_base_t* task = slots[t % capacity].load(std::memory_order_relaxed);
+					if (top.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+						return task;
+					}
+				}
+			}
+
+			bool empty() const noexcept {
+				return static_cast<ptrdiff_t>(bottom.load(std::memory_order_acquire) - top.load(std::memory_order_acquire)) <= 0;
+			}
+
+			alignas(64) std::atomic<size_t> top;
+			alignas(64) std::atomic<size_t> bottom;
+			std::atomic<task_base_t*> slots[capacity];
+		};
+
+		// global FIFO queue for external submitters and overflowed deques
+		struct alignas(64) inject_queue_t {
+			inject_queue_t() noexcept {
+				size.store(0, std::memory_order_relaxed);
+			}
+
+			void push(task_base_t* task) {
+				std::lock_guard<std::mutex> guard(mutex);
+				task->next = nullptr;
+				if (tail != nullptr) {
+					tail->next = task;
+				} else {
+					head = task;
+				}
+
+				tail = task;
+				size.fetch_add(1, std::memory_order_release);
+			}
+
+			// push a pre-linked chain under one lock
+			void push_chain(task_base_t* first, task_base_t* last, size_t count) {
+				std::lock_guard<std::mutex> guard(mutex);
+				last->next = nullptr;
+				if (tail != nullptr) {
+					tail->next = first;
+				} else {
+					head = first;
+				}
+
+				tail = last;
+				size.fetch_add(count, std::memory_order_release);
+			}
+
+			task_base_t* pop() {
+				if (size.load(std::memory_order_acquire) == 0) {
+					return nullptr;
+				}
+
+				std::lock_guard<std::mutex> guard(mutex);
+				task_base_t* task = head;
+				if (task != nullptr) {
+					head = task->next;
+					if (head == nullptr) {
+						tail = nullptr;
+					}
+
+					task->next = nullptr;
+					size.fetch_sub(1, std::memory_order_relaxed);
+				}
+
+				return task;
+			}
+
+			bool empty() const noexcept {
+				return size.load(std::memory_order_acquire) == 0;
+			}
+
+			std::mutex mutex;
+			task_base_t* head = nullptr;
+			task_base_t* tail = nullptr;
+			std::atomic<size_t> size;
+		};
+
+		// min-heap of tasks with deadlines, earliest deadline first
+		struct alignas(64) deadline_queue_t {
+			struct node_t {
+				std::chrono::steady_clock::time_point deadline;
+				task_base_t* task;
+
+				bool operator < (const node_t& rhs) const noexcept {
+					return deadline > rhs.deadline;
+				}
+			};
+
+			deadline_queue_t() noexcept {
+				size.store(0, std::memory_order_relaxed);
+			}
+
+			void push(task_base_t* task, std::chrono::steady_clock::time_point deadline) {
+				std::lock_guard<std::mutex> guard(mutex);
+				nodes.push_back(node_t{ deadline, task });
+				std::push_heap(nodes.begin(), nodes.end());
+				size.fetch_add(1, std::memory_order_release);
+			}
+
+			// pop the earliest one, only if it is not later than limit
+			task_base_t* pop(std::chrono::steady_clock::time_point& deadline, std::chrono::steady_clock::time_point limit = std::chrono::steady_clock::time_point::max()) {
+				if (size.load(std::memory_order_acquire) == 0) {
+					return nullptr;
+				}
+
+				std::lock_guard<std::mutex> guard(mutex);
+				if (nodes.empty() || nodes.front().deadline > limit) {
+					return nullptr;
+				}
+
+				std::pop_heap(nodes.begin(), nodes.end());
+				deadline = nodes.back().deadline;
+				task_base_t* task = nodes.back().task;
+				nodes.pop_back();
+				size.fetch_sub(1, std::memory_order_relaxed);
+
+				return task;
+			}
+
+			bool empty() const noexcept {
+				return size.load(std::memory_order_acquire) == 0;
+			}
+
+			std::mutex mutex;
+			std::vector<node_t> nodes;
+			std::atomic<size_t> size;
+		};
+
+		// parking slot of one thread, blocks on a futex on linux, or on its own condition variable elsewhere
+		struct alignas(64) park_slot_t {
+			enum : uint32_t { state_running = 0, state_parked = 1, state_notified = 2 };
+			static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex requires plain 32-bit atomics");
+
+			park_slot_t() noexcept {
+				state.store(state_running, std::memory_order_relaxed);
+			}
+
+			// must be called before the slot could be found by notifiers
+			void prepare() noexcept {
+				state.store(state_parked, std::memory_order_seq_cst);
+			}
+
+			void finish() noexcept {
+				state.store(state_running, std::memory_order_relaxed);
+			}
+
+			// wait until notified or deadline reached
+			void wait(std::chrono::steady_clock::time_point deadline) {
+				while (state.load(std::memory_order_acquire) == state_parked) {
+#if defined(__linux__)
+					timespec ts;
+					timespec* timeout = nullptr;
+					if (deadline != std::chrono::steady_clock::time_point::max()) {
+						auto now = std::chrono::steady_clock::now();
+						if (now >= deadline) {
+							return;
+						}
+
+						int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+						ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+						ts.tv_nsec = static_cast<long>(ns % 1000000000);
+						timeout = &ts;
+					}
+
+					syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state), FUTEX_WAIT_PRIVATE, uint32_t(state_parked), timeout, nullptr, 0);
+#else
+					std::unique_lock<std::mutex> lock(mutex);
+					if (state.load(std::memory_order_acquire) != state_parked) {
+						break;
+					}
+
+					if (deadline == std::chrono::steady_clock::time_point::max()) {
+						condition.wait(lock);
+					} else if (condition.wait_until(lock, deadline) == std::cv_status::timeout) {
+						return;
+					}
+#endif
+				}
+			}
+
+			void notify() {
+				if (state.exchange(state_notified, std::memory_order_acq_rel) == state_parked) {
+#if defined(__linux__)
+					syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+					std::lock_guard<std::mutex> lock(mutex);
+					condition.notify_one();
+#endif
+				}
+			}
+
+			std::atomic<uint32_t> state;
+#if !defined(__linux__)
+			std::mutex mutex;
+			std::condition_variable condition;
+#endif
+		};
+
+		static constexpr size_t park_spin_count = 64;
 
 		template <typename element_t>
 		using general_allocator_t = allocator_t<element_t>;
@@ -1150,12 +1496,38 @@ namespace iris {
 		using large_task_allocator_t = allocator_t<large_task_t>;
 		using root_allocator_t = typename task_allocator_t::root_allocator_t;
 
-		iris_async_worker_t() : waiting_thread_count(0), limit_count(0), internal_thread_count(0), priority_task_threshold(0) {
+		// hierarchical timer wheel for delayed tasks, each level has timer_wheel_size slots, 1ms per tick at level 0.
+		static constexpr size_t timer_wheel_bits = 6;
+		static constexpr size_t timer_wheel_size = 1u << timer_wheel_bits;
+		static constexpr size_t timer_wheel_mask = timer_wheel_size - 1;
+		static constexpr size_t timer_wheel_levels = 5; // about 12 days, longer delays wait in an overflow list
+		using timer_clock_t = std::chrono::steady_clock;
+
+		struct timer_node_t {
+			task_base_t* task;
+			uint64_t expire;
+			size_t priority;
+		};
+
+		iris_async_worker_t() : limit_count(0), internal_thread_count(0), priority_task_threshold(0), timer_current_tick(0) {
 			proxy_get_current_thread_index = &iris_async_worker_t::get_current_thread_index_internal;
+			timer_base = timer_clock_t::now();
+			timer_next_tick.store(~uint64_t(0), std::memory_order_relaxed);
+			std::fill(std::begin(timer_level_counts), std::end(timer_level_counts), size_t(0));
 			priority_task_handler = [](task_base_t*, size_t&) { return false; };
-			task_allocator_index.store(0, std::memory_order_relaxed);
 			running_count.store(0, std::memory_order_relaxed);
-			task_count.store(0, std::memory_order_relaxed);
+			for (size_t i = 0; i < counter_shard_count; i++) {
+				task_counts[i].value.store(0, std::memory_order_relaxed);
+			}
+
+			waiting_thread_count.store(0, std::memory_order_relaxed);
+			active_thread_count.store(0, std::memory_order_relaxed);
+			timer_task_count.store(0, std::memory_order_relaxed);
+			foreign_waiting_count.store(0, std::memory_order_relaxed);
+			deadline_task_count.store(0, std::memory_order_relaxed);
+			yield_task_count.store(0, std::memory_order_relaxed);
+			expired_task_count.store(0, std::memory_order_relaxed);
+			timer_keeper.store(~size_t(0), std::memory_order_relaxed);
 			terminated.store(1, std::memory_order_release);
 		}
 
@@ -1163,41 +1535,128 @@ namespace iris {
 			resize(thread_count);
 		}
 
+		// set the capacity of internal threads, all of them are active by default
 		void resize(size_t thread_count) {
 			IRIS_ASSERT(task_heads.empty()); // must not started
 
 			threads.resize(thread_count);
 			internal_thread_count = thread_count;
+			active_thread_count.store(thread_count, std::memory_order_release);
+		}
+
+		// change the count of running internal threads within [0, capacity], could be called after start()
+		// retired threads exit after finishing the current task, their queued tasks are taken by the others
+		size_t scale(size_t thread_count) {
+			std::lock_guard<std::mutex> guard(scale_mutex);
+			thread_count = std::min(thread_count, internal_thread_count);
+			size_t current_count = active_thread_count.load(std::memory_order_acquire);
+			active_thread_count.store(thread_count, std::memory_order_release);
+
+			if (!thread_states) {
+				// not started
+				return thread_count;
+			}
+
+			for (size_t i = thread_count; i < current_count; i++) {
+				uint32_t expected = thread_state_running;
+				if (thread_states[i].compare_exchange_strong(expected, thread_state_retiring, std::memory_order_acq_rel)) {
+					unpark(i);
+				}
+			}
+
+			for (size_t i = current_count; i < thread_count; i++) {
+				// still running? just cancel the retirement
+				uint32_t expected = thread_state_retiring;
+				if (!thread_states[i].compare_exchange_strong(expected, thread_state_running, std::memory_order_acq_rel)) {
+					if (threads[i].joinable()) {
+						threads[i].join();
+					}
+
+					thread_states[i].store(thread_state_running, std::memory_order_release);
+					spawn(i);
+				}
+			}
+
+			return thread_count;
+		}
+
+		size_t get_active_thread_count() const noexcept {
+			return active_thread_count.load(std::memory_order_acquire);
+		}
+
+		// count of threads polling or running tasks, 0 if all threads are parked. a single load, cheaper than get_task_count()
+		size_t get_running_count() const noexcept {
+			return running_count.load(std::memory_order_acquire);
 		}
 
 		// initialize and start thread poll
 		void start() {
 			IRIS_ASSERT(task_heads.empty()); // must not started
 
-			std::vector<std::atomic<task_base_t*>> heads(threads.size() * task_head_duplicate_count);
+			if constexpr (work_stealing) {
+				// one deque per thread and priority, one injection queue per priority
+				priority_count = std::max(internal_thread_count, (size_t)1);
+				steal_deques.reset(new steal_deque_t[threads.size() * priority_count]);
+				inject_queues.reset(new inject_queue_t[priority_count]);
+			}
+
+			// one deadline queue per priority
+			deadline_queue_count = std::max(internal_thread_count, (size_t)1);
+			deadline_queues.reset(new deadline_queue_t[deadline_queue_count]);
+			yield_queues.reset(new deadline_queue_t[deadline_queue_count]);
+
+			std::vector<task_head_t> heads(work_stealing ? 1 : threads.size() * task_head_duplicate_count);
 			for (size_t i = 0; i < heads.size(); i++) {
-				heads[i].store(nullptr, std::memory_order_relaxed);
+				heads[i].value.store(nullptr, std::memory_order_relaxed);
 			}
 
 			task_heads = std::move(heads);
-			terminated.store(0, std::memory_order_release);
 
+			// one parking slot and one idle bit per thread
+			idle_mask_count = (threads.size() + 63) / 64;
+			park_slots.reset(new park_slot_t[threads.size()]);
+			idle_masks.reset(new std::atomic<uint64_t>[idle_mask_count]);
+			for (size_t i = 0; i < idle_mask_count; i++) {
+				idle_masks[i].store(0, std::memory_order_relaxed);
+			}
+
+			std::lock_guard<std::mutex> guard(scale_mutex);
+			size_t active_count = active_thread_count.load(std::memory_order_acquire);
+			thread_states.reset(new std::atomic<uint32_t>[internal_thread_count]);
 			for (size_t i = 0; i < internal_thread_count; i++) {
-				threads[i] = thread_t([this, i]() {
-					IRIS_PROFILE_THREAD("iris_async_worker", i);
-					thread_loop(i);
-				});
+				thread_states[i].store(i < active_count ? thread_state_running : thread_state_exited, std::memory_order_relaxed);
+			}
+
+			terminated.store(0, std::memory_order_release);
+
+			for (size_t i = 0; i < active_count; i++) {
+				spawn(i);
 			}
 		}
 
 		void make_current(size_t i) noexcept {
-			proxy_get_current_thread_index() = i;
+			thread_index_t& index = proxy_get_current_thread_index();
+			index.value = i;
+			index.owner = i == ~size_t(0) ? nullptr : this;
 		}
 
 		void thread_loop(size_t i) {
 			make_current(i);
+			if (thread_init_handler) {
+				thread_init_handler(i);
+			}
 
 			while (!is_terminated()) {
+				if (i < internal_thread_count && thread_states[i].load(std::memory_order_acquire) == thread_state_retiring) {
+					uint32_t expected = thread_state_retiring;
+					if (thread_states[i].compare_exchange_strong(expected, thread_state_exited, std::memory_order_acq_rel)) {
+						// hand over remaining tasks and timers
+						wakeup_one();
+						break;
+					}
+				}
+
+				poll_timers();
 				if (!poll_one()) {
 					delay();
 				}
@@ -1257,10 +1716,7 @@ namespace iris {
 		template <typename duration_t>
 		bool poll_one(size_t priority, duration_t&& delay) {
 			if (!poll_one(priority)) {
-				std::unique_lock<std::mutex> lock(mutex);
-				condition.wait_for(lock, std::forward<duration_t>(delay));
-				lock.unlock();
-
+				park(timer_clock_t::now() + std::forward<duration_t>(delay), false);
 				return poll_one(priority);
 			} else {
 				return true;
@@ -1278,20 +1734,34 @@ namespace iris {
 			terminate();
 			join();
 
-			IRIS_ASSERT(task_count.load(std::memory_order_acquire) == 0);
+			IRIS_ASSERT(get_task_count() == 0);
 		}
 
 		// get current thread index
-		size_t get_current_thread_index() const noexcept { return proxy_get_current_thread_index(); }
+		size_t get_current_thread_index() const noexcept {
+			const thread_index_t& index = proxy_get_current_thread_index();
+			return index.owner == this ? index.value : ~size_t(0);
+		}
 
 		// get the count of threads in worker, including customized threads
 		size_t get_thread_count() const noexcept {
 			return threads.size();
 		}
 
-		// get the count of waiting task
+		// get the count of waiting task, summed from shards so it is only a snapshot
 		size_t get_task_count() const noexcept {
-			return task_count.load(std::memory_order_acquire);
+			size_t count = 0;
+			for (size_t i = 0; i < counter_shard_count; i++) {
+				count += task_counts[i].value.load(std::memory_order_acquire);
+			}
+
+			// shards wrap around if tasks are executed on other threads, the sum does not
+			return static_cast<ptrdiff_t>(count) < 0 ? 0 : count;
+		}
+
+		// get the count of delayed tasks not yet expired
+		size_t get_timer_task_count() const noexcept {
+			return timer_task_count.load(std::memory_order_acquire);
 		}
 
 		// limit the count of running thread. e.g. 0 is not limited, 1 is to pause one thread from running, etc.
@@ -1309,19 +1779,22 @@ namespace iris {
 		typename std::enable_if<is_large_task<typename std::remove_reference<callable_t>::type>::value, task_base_t*>::type new_task(callable_t&& func) {
 			large_task_t* task = large_task_allocator.allocate(1);
 			new (task) large_task_t(std::forward<callable_t>(func), nullptr, 0);
-			task_count.fetch_add(1, std::memory_order_relaxed);
+			task_counts[get_shard_index()].value.fetch_add(1, std::memory_order_relaxed);
 
 			return task;
 		}
 
 		template <typename callable_t>
 		typename std::enable_if<!is_large_task<typename std::remove_reference<callable_t>::type>::value, task_base_t*>::type new_task(callable_t&& func) {
-			size_t index = task_allocator_index.fetch_add(1, std::memory_order_relaxed) % sub_allocator_count;
+			// each thread sticks to one sub allocator
+			size_t slot = get_thread_slot();
+			size_t shard = slot % counter_shard_count;
+			size_t index = slot % sub_allocator_count;
 			task_allocator_t& current_allocator = task_allocators[index];
 			task_t<callable_t>* task = reinterpret_cast<task_t<callable_t>*>(current_allocator.allocate(1));
 			static_assert(sizeof(task_t<callable_t>) == sizeof(normal_task_t), "Task size mismatch!");
 			new (task) task_t<callable_t>(std::forward<callable_t>(func), nullptr, index + 1);
-			task_count.fetch_add(1, std::memory_order_relaxed);
+			task_counts[shard].value.fetch_add(1, std::memory_order_relaxed);
 
 			return task;
 		}
@@ -1356,7 +1829,7 @@ namespace iris {
 						worker.task_allocators[index - 1].deallocate(static_cast<normal_task_t*>(task), 1);
 					}
 					
-					worker.task_count.fetch_sub(1, std::memory_order_release);
+					worker.task_counts[worker.get_shard_index()].value.fetch_sub(1, std::memory_order_release);
 				}
 			}
 
@@ -1380,6 +1853,17 @@ namespace iris {
 				IRIS_ASSERT(!threads.empty());
 				priority = std::min(priority, std::max(internal_thread_count, (size_t)1) - 1u);
 
+				if constexpr (work_stealing) {
+					// pool threads push to their own deques, others go to the injection queue
+					size_t current_thread_index = get_current_thread_index();
+					if (current_thread_index >= threads.size() || !get_steal_deque(current_thread_index, priority).push(task)) {
+						inject_queues[priority].push(task);
+					}
+
+					wakeup_one_with_priority(priority);
+					return;
+				}
+
 				// try empty slots first
 				size_t index = 0;
 				ptrdiff_t max_diff = std::numeric_limits<ptrdiff_t>::min();
@@ -1389,7 +1873,7 @@ namespace iris {
 
 				for (size_t n = 0; n < task_head_duplicate_count; n++) {
 					size_t k = (n + current_thread_index) % task_head_duplicate_count;
-					std::atomic<task_base_t*>& task_head = task_heads[priority + k * thread_count];
+					std::atomic<task_base_t*>& task_head = task_heads[priority + k * thread_count].value;
 					task_base_t* expected = nullptr;
 					if (task_head.compare_exchange_strong(expected, task, std::memory_order_release)) {
 						// dispatch immediately
@@ -1405,7 +1889,7 @@ namespace iris {
 				}
 
 				// full, chain to farest one
-				std::atomic<task_base_t*>& task_head = task_heads[priority + index * thread_count];
+				std::atomic<task_base_t*>& task_head = task_heads[priority + index * thread_count].value;
 
 				// avoid legacy compiler bugs
 				// see https://en.cppreference.com/w/cpp/atomic/atomic/compare_exchange
@@ -1421,7 +1905,7 @@ namespace iris {
 				execute_task(task); // execute immediately
 			} else {
 				// terminate requested, chain to default task_head at 0
-				std::atomic<task_base_t*>& task_head = task_heads[0];
+				std::atomic<task_base_t*>& task_head = task_heads[0].value;
 				task_base_t* node = task_head.load(std::memory_order_relaxed);
 				do {
 					task->next = node;
@@ -1434,9 +1918,150 @@ namespace iris {
 			queue_task(new_task(std::forward<callable_t>(callable)), priority);
 		}
 
+		// queue a task with a deadline, tasks with deadlines are picked before others in earliest deadline first order.
+		// expired tasks still run (so they can release their resources), check the deadline inside to skip the work.
+		void queue_task_deadline(task_base_t* task, timer_clock_t::time_point deadline, size_t priority = 0) {
+			if (deadline == timer_clock_t::time_point::max() || static_cast<ptrdiff_t>(priority) < 0 || is_terminated() || !deadline_queues) {
+				queue_task(task, priority);
+				return;
+			}
+
+			priority = std::min(priority, deadline_queue_count - 1u);
+			deadline_task_count.fetch_add(1, std::memory_order_relaxed);
+			deadline_queues[priority].push(task, deadline);
+			wakeup_one_with_priority(priority);
+		}
+
+		template <typename callable_t>
+		void queue_deadline(callable_t&& callable, timer_clock_t::time_point deadline, size_t priority = 0) {
+			queue_task_deadline(new_task(std::forward<callable_t>(callable)), deadline, priority);
+		}
+
+		// queue a task yielding its thread, e.g. a long running coroutine that used up its time slice.
+		// it is picked only if no other task of its priority is waiting, or once resume_time is reached
+		void queue_task_yield(task_base_t* task, timer_clock_t::time_point resume_time, size_t priority = 0) {
+			if (static_cast<ptrdiff_t>(priority) < 0 || is_terminated() || !yield_queues) {
+				queue_task(task, priority);
+				return;
+			}
+
+			priority = std::min(priority, deadline_queue_count - 1u);
+			yield_task_count.fetch_add(1, std::memory_order_relaxed);
+			yield_queues[priority].push(task, resume_time);
+			wakeup_one_with_priority(priority);
+		}
+
+		template <typename callable_t>
+		void queue_yield(callable_t&& callable, timer_clock_t::time_point resume_time, size_t priority = 0) {
+			queue_task_yield(new_task(std::forward<callable_t>(callable)), resume_time, priority);
+		}
+
+		// get the count of tasks with deadlines picked after their deadlines
+		size_t get_expired_task_count() const noexcept {
+			return expired_task_count.load(std::memory_order_acquire);
+		}
+
+		// queue count tasks made by generator(i) with a single publish
+		template <typename generator_t>
+		void queue_batch(size_t count, generator_t&& generator, size_t priority = 0) {
+			task_base_t* head = nullptr;
+			task_base_t* tail = nullptr;
+			for (size_t i = 0; i < count; i++) {
+				task_base_t* task = new_task(generator(i));
+				if (tail != nullptr) {
+					tail->next = task;
+				} else {
+					head = task;
+				}
+
+				tail = task;
+			}
+
+			queue_task_batch(head, priority);
+		}
+
+		// queue a chain of tasks linked by next, publishes with one cas per task head and wakes up min(count, idle) threads
+		void queue_task_batch(task_base_t* head, size_t priority = 0) {
+			if (head == nullptr) {
+				return;
+			}
+
+			size_t count = 1;
+			task_base_t* tail = head;
+			while (tail->next != nullptr) {
+				tail = tail->next;
+				count++;
+			}
+
+			if (static_cast<ptrdiff_t>(priority) < 0 || is_terminated()) {
+				// let queue_task handle special cases one by one
+				while (head != nullptr) {
+					task_base_t* next = head->next;
+					head->next = nullptr;
+					queue_task(head, priority);
+					head = next;
+				}
+
+				return;
+			}
+
+			IRIS_ASSERT(!threads.empty());
+			priority = std::min(priority, std::max(internal_thread_count, (size_t)1) - 1u);
+
+			if constexpr (work_stealing) {
+				// fill own deque first, the overflow goes to the injection queue under one lock
+				size_t left = count;
+				size_t current_thread_index = get_current_thread_index();
+				if (current_thread_index < threads.size()) {
+					steal_deque_t& deque = get_steal_deque(current_thread_index, priority);
+					while (head != nullptr) {
+						task_base_t* next = head->next;
+						head->next = nullptr;
+						if (!deque.push(head)) {
+							head->next = next;
+							break;
+						}
+
+						head = next;
+						left--;
+					}
+				}
+
+				if (head != nullptr) {
+					inject_queues[priority].push_chain(head, tail, left);
+				}
+			} else {
+				// split the chain into at most task_head_duplicate_count parts, one cas for each
+				size_t thread_count = threads.size();
+				size_t current_thread_index = get_current_thread_index();
+				current_thread_index = current_thread_index == ~size_t(0) ? 0 : current_thread_index;
+				size_t part_count = std::min(count, task_head_duplicate_count);
+
+				for (size_t n = 0; n < part_count; n++) {
+					size_t part_size = count / part_count + (n < count % part_count ? 1 : 0);
+					task_base_t* first = head;
+					task_base_t* last = head;
+					for (size_t i = 1; i < part_size; i++) {
+						last = last->next;
+					}
+
+					head = last->next;
+
+					size_t k = (n + current_thread_index) % task_head_duplicate_count;
+					std::atomic<task_base_t*>& task_head = task_heads[priority + k * thread_count].value;
+					task_base_t* node = task_head.load(std::memory_order_relaxed);
+					do {
+						last->next = node;
+					} while (!task_head.compare_exchange_weak(node, first, std::memory_order_acq_rel, std::memory_order_relaxed));
+				}
+			}
+
+			wakeup_with_priority(priority, count);
+		}
+
 		// mark as terminated
 		void terminate() {
-			terminated.store(1, std::memory_order_release);
+			terminated.store(1, std::memory_order_seq_cst);
 			wakeup_all();
 		}
 
@@ -1457,10 +2082,27 @@ namespace iris {
 
 			IRIS_ASSERT(running_count.load(std::memory_order_acquire) == 0);
 			IRIS_ASSERT(waiting_thread_count == 0);
-			while (poll()) {}
+
+			// delayed tasks are fired at once
+			do {
+				flush_timers();
+			} while (poll());
 
 			task_heads.clear();
 			threads.clear();
+			thread_states.reset();
+			deadline_queues.reset();
+			yield_queues.reset();
+			deadline_queue_count = 0;
+			park_slots.reset();
+			idle_masks.reset();
+			idle_mask_count = 0;
+
+			if constexpr (work_stealing) {
+				steal_deques.reset();
+				inject_queues.reset();
+				priority_count = 0;
+			}
 		}
 
 		bool empty() const noexcept {
@@ -1472,9 +2114,37 @@ namespace iris {
 			IRIS_PROFILE_SCOPE(__FUNCTION__);
 
 			bool empty = true;
-			for (size_t i = 0; i < task_heads.size(); i++) {
-				std::atomic<task_base_t*>& task_head = task_heads[i];
-				task_base_t* task = task_head.exchange(nullptr, std::memory_order_acquire);
+			for (size_t n = 0; n < deadline_queue_count; n++) {
+				task_base_t* task;
+				timer_clock_t::time_point deadline;
+				while ((task = deadline_queues[n].pop(deadline)) != nullptr) {
+					empty = false;
+					deadline_task_count.fetch_sub(1, std::memory_order_relaxed);
+					execute_task(task);
+				}
+
+				while ((task = yield_queues[n].pop(deadline)) != nullptr) {
+					empty = false;
+					yield_task_count.fetch_sub(1, std::memory_order_relaxed);
+					execute_task(task);
+				}
+			}
+
+			if constexpr (work_stealing) {
+				if (steal_deques) {
+					for (size_t n = 0; n < priority_count; n++) {
+						task_base_t* task;
+						while ((task = take_task(n)) != nullptr) {
+							empty = false;
+							execute_task(task);
+						}
+					}
+				}
+			}
+
+			for (size_t i = 0; i < task_heads.size(); i++) {
+				std::atomic<task_base_t*>& task_head = task_heads[i].value;
+				task_base_t* task = task_head.exchange(nullptr, std::memory_order_acquire);
 				empty = empty && (task == nullptr);
 
 				while (task != nullptr) {
@@ -1488,28 +2158,165 @@ namespace iris {
 		}
 
 		// notify threads in thread pool, usually used for customized threads
+		// wakes exactly one parked thread if any
 		void wakeup_one() {
-			std::lock_guard<std::mutex> lock(mutex);
-			condition.notify_one();
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!unpark_one() && foreign_waiting_count.load(std::memory_order_acquire) != 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				condition.notify_one();
+			}
 		}
 
 		void wakeup_all() {
-			std::lock_guard<std::mutex> lock(mutex);
-			condition.notify_all();
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			for (size_t i = 0; i < idle_mask_count; i++) {
+				uint64_t mask = idle_masks[i].exchange(0, std::memory_order_acq_rel);
+				while (mask != 0) {
+					uint32_t index = iris_get_trailing_zeros(mask);
+					mask &= mask - 1;
+					park_slots[i * 64 + index].notify();
+				}
+			}
+
+			if (foreign_waiting_count.load(std::memory_order_acquire) != 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				condition.notify_all();
+			}
 		}
 
 		// blocked delay for any task
 		void delay() {
 			if (!is_terminated()) {
-				std::unique_lock<std::mutex> lock(mutex);
-				waiting_guard_t guard(this);
+				// spin briefly before parking
+				for (size_t i = 0; i < park_spin_count; i++) {
+					if (is_terminated() || is_retiring() || has_task(waiting_thread_count.load(std::memory_order_acquire) + 1)) {
+						return;
+					}
 
-				if (fetch(waiting_thread_count).first == ~size_t(0)) {
-					if (!is_terminated()) {
-						condition.wait(lock);
+					cpu_relax();
+				}
+
+				park(timer_clock_t::time_point::max(), true);
+			}
+		}
+
+		// queue a task after given delay, it is dispatched with given priority on expiration.
+		template <typename callable_t, typename rep_t, typename period_t>
+		void queue_delayed(callable_t&& callable, std::chrono::duration<rep_t, period_t> duration, size_t priority = 0) {
+			queue_task_delayed(new_task(std::forward<callable_t>(callable)), duration, priority);
+		}
+
+		// returns the expiration tick of the timer, see cancel_task_delayed()
+		template <typename rep_t, typename period_t>
+		uint64_t queue_task_delayed(task_base_t* task, std::chrono::duration<rep_t, period_t> duration, size_t priority = 0) {
+			IRIS_ASSERT(task != nullptr && task->next == nullptr);
+			if (duration <= std::chrono::duration<rep_t, period_t>::zero()) {
+				queue_task(task, priority);
+				return 0;
+			}
+
+			// round up, never expire earlier than required
+			auto elapsed = timer_clock_t::now() + duration - timer_base;
+			uint64_t expire = static_cast<uint64_t>(std::chrono::ceil<std::chrono::milliseconds>(elapsed).count());
+
+			bool earlier = false;
+			do {
+				std::lock_guard<std::mutex> guard(timer_mutex);
+				expire = std::max(expire, timer_current_tick + 1);
+				timer_node_t node = { task, expire, priority };
+				insert_timer(node);
+				timer_task_count.fetch_add(1, std::memory_order_relaxed);
+
+				if (node.expire < timer_next_tick.load(std::memory_order_relaxed)) {
+					timer_next_tick.store(node.expire, std::memory_order_release);
+					earlier = true;
+				}
+			} while (false);
+
+			if (earlier) {
+				// the timer keeper waits for a later deadline, wake it up to wait again
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				size_t keeper = timer_keeper.load(std::memory_order_acquire);
+				if (keeper != ~size_t(0)) {
+					unpark(keeper);
+				} else if (waiting_thread_count.load(std::memory_order_acquire) != 0) {
+					wakeup_one();
+				}
+
+				if (foreign_waiting_count.load(std::memory_order_acquire) != 0) {
+					std::lock_guard<std::mutex> lock(mutex);
+					condition.notify_all();
+				}
+			}
+
+			return expire;
+		}
+
+		// take a delayed task out of the wheel before it expires, the caller owns the task on success.
+		// returns false if the task is already dispatched (or being dispatched).
+		bool cancel_task_delayed(task_base_t* task, uint64_t expire) {
+			std::lock_guard<std::mutex> guard(timer_mutex);
+			std::vector<timer_node_t>* slot = &timer_overflow;
+			size_t slot_level = timer_wheel_levels;
+			uint64_t diff = expire ^ timer_current_tick;
+			for (size_t level = timer_wheel_levels; level != 0; level--) {
+				size_t shift = (level - 1) * timer_wheel_bits;
+				if ((diff >> shift) != 0) {
+					if (level != timer_wheel_levels || (diff >> (shift + timer_wheel_bits)) == 0) {
+						slot = &timer_slots[level - 1][(expire >> shift) & timer_wheel_mask];
+						slot_level = level - 1;
+					}
+
+					break;
+				}
+			}
+
+			for (size_t i = 0; i < slot->size(); i++) {
+				if ((*slot)[i].task == task) {
+					(*slot)[i] = slot->back();
+					slot->pop_back();
+					if (slot_level != timer_wheel_levels) {
+						timer_level_counts[slot_level]--;
 					}
+
+					// timer_next_tick may point to an empty slot now, it only costs a spurious wakeup
+					timer_task_count.fetch_sub(1, std::memory_order_relaxed);
+					return true;
 				}
 			}
+
+			return false;
+		}
+
+		// queue expired delayed tasks, returns true if any
+		bool poll_timers() {
+			uint64_t next_tick = timer_next_tick.load(std::memory_order_acquire);
+			if (next_tick == ~uint64_t(0)) {
+				return false;
+			}
+
+			uint64_t now_tick = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(timer_clock_t::now() - timer_base).count());
+			if (now_tick < next_tick) {
+				return false;
+			}
+
+			return expire_timers(now_tick);
+		}
+
+		// queue all delayed tasks regardless of their deadlines
+		bool flush_timers() {
+			return expire_timers(~uint64_t(0));
+		}
+
+		// get the nearest deadline of delayed tasks, or time_point::max() if there is none
+		timer_clock_t::time_point get_next_timer_deadline() const noexcept {
+			uint64_t next_tick = timer_next_tick.load(std::memory_order_acquire);
+			return next_tick == ~uint64_t(0) ? timer_clock_t::time_point::max() : timer_base + std::chrono::milliseconds(next_tick);
+		}
+
+		// called at the beginning of each internal thread (including respawned ones), e.g. to set affinity
+		void set_thread_init_handler(std::function<void(size_t)>&& handler) noexcept {
+			thread_init_handler = std::move(handler);
 		}
 
 		void set_priority_task_handler(std::function<bool(task_base_t*, size_t&)>&& handler, size_t threshold) noexcept {
@@ -1517,34 +2324,418 @@ namespace iris {
 			priority_task_threshold = threshold;
 		}
 
+		// thread index is scoped by worker, a thread of one worker is an external thread to others
 		struct thread_index_t {
-			thread_index_t() noexcept : value(~size_t(0)) {}
+			thread_index_t() noexcept : value(~size_t(0)), owner(nullptr) {}
 			size_t value;
+			const void* owner;
 		};
 
+		// slot of the current thread, external threads are spread by the address of their thread local index
+		size_t get_thread_slot() const noexcept {
+			const thread_index_t& index = proxy_get_current_thread_index();
+			return index.owner == this ? index.value : reinterpret_cast<size_t>(&index) / 64;
+		}
+
+		// shard of per-thread counters
+		size_t get_shard_index() const noexcept {
+			return get_thread_slot() % counter_shard_count;
+		}
+
 	protected:
-		static size_t& get_current_thread_index_internal() noexcept {
-			return iris_static_instance_t<thread_index_t>::get_thread_local().value;
+		// place a timer node to the level of the highest digit differing from current tick
+		void insert_timer(const timer_node_t& node) {
+			uint64_t diff = node.expire ^ timer_current_tick;
+			for (size_t level = timer_wheel_levels; level != 0; level--) {
+				size_t shift = (level - 1) * timer_wheel_bits;
+				if ((diff >> shift) != 0) {
+					if (level == timer_wheel_levels && (diff >> (shift + timer_wheel_bits)) != 0) {
+						timer_overflow.emplace_back(node);
+					} else {
+						timer_slots[level - 1][(node.expire >> shift) & timer_wheel_mask].emplace_back(node);
+						timer_level_counts[level - 1]++;
+					}
+
+					return;
+				}
+			}
+
+			// already expired
+			timer_expired.emplace_back(node);
+		}
+
+		void cascade_timers(size_t level) {
+			size_t shift = level * timer_wheel_bits;
+			std::vector<timer_node_t>& slot = timer_slots[level][(timer_current_tick >> shift) & timer_wheel_mask];
+			timer_level_counts[level] -= slot.size();
+			timer_cascading.swap(slot);
+
+			for (size_t i = 0; i < timer_cascading.size(); i++) {
+				insert_timer(timer_cascading[i]);
+			}
+
+			timer_cascading.clear();
+		}
+
+		// advance the wheel to target tick, skipping ranges without timers
+		void advance_timers(uint64_t target_tick) {
+			while (timer_current_tick < target_tick) {
+				uint64_t next_tick = timer_current_tick + 1;
+				for (size_t level = 0; level < timer_wheel_levels && timer_level_counts[level] == 0; level++) {
+					size_t shift = (level + 1) * timer_wheel_bits;
+					next_tick = ((timer_current_tick >> shift) + 1) << shift;
+				}
+
+				next_tick = std::min(next_tick, target_tick);
+
+				uint64_t diff = next_tick ^ timer_current_tick;
+				timer_current_tick = next_tick;
+
+				if ((diff >> (timer_wheel_levels * timer_wheel_bits)) != 0) {
+					timer_cascading.swap(timer_overflow);
+					for (size_t i = 0; i < timer_cascading.size(); i++) {
+						insert_timer(timer_cascading[i]);
+					}
+
+					timer_cascading.clear();
+				}
+
+				for (size_t level = timer_wheel_levels - 1; level != 0; level--) {
+					if ((diff >> (level * timer_wheel_bits)) != 0) {
+						cascade_timers(level);
+					}
+				}
+
+				std::vector<timer_node_t>& slot = timer_slots[0][timer_current_tick & timer_wheel_mask];
+				timer_level_counts[0] -= slot.size();
+				timer_expired.insert(timer_expired.end(), slot.begin(), slot.end());
+				slot.clear();
+			}
+		}
+
+		// find the nearest slot to wake up at, a higher level slot wakes us up for cascading
+		uint64_t find_next_timer_tick() const noexcept {
+			for (size_t level = 0; level < timer_wheel_levels; level++) {
+				if (timer_level_counts[level] != 0) {
+					size_t shift = level * timer_wheel_bits;
+					size_t digit = (timer_current_tick >> shift) & timer_wheel_mask;
+					for (size_t i = digit + 1; i < timer_wheel_size; i++) {
+						if (!timer_slots[level][i].empty()) {
+							return ((timer_current_tick >> (shift + timer_wheel_bits)) << (shift + timer_wheel_bits)) | (uint64_t(i) << shift);
+						}
+					}
+				}
+			}
+
+			if (!timer_overflow.empty()) {
+				size_t shift = timer_wheel_levels * timer_wheel_bits;
+				return ((timer_current_tick >> shift) + 1) << shift;
+			}
+
+			return ~uint64_t(0);
+		}
+
+		bool expire_timers(uint64_t target_tick) {
+			std::vector<timer_node_t> expired;
+			do {
+				std::lock_guard<std::mutex> guard(timer_mutex);
+				if (target_tick == ~uint64_t(0)) {
+					// flush all
+					for (size_t level = 0; level < timer_wheel_levels; level++) {
+						for (size_t i = 0; i < timer_wheel_size; i++) {
+							std::vector<timer_node_t>& slot = timer_slots[level][i];
+							timer_expired.insert(timer_expired.end(), slot.begin(), slot.end());
+							slot.clear();
+						}
+
+						timer_level_counts[level] = 0;
+					}
+
+					timer_expired.insert(timer_expired.end(), timer_overflow.begin(), timer_overflow.end());
+					timer_overflow.clear();
+				} else {
+					advance_timers(target_tick);
+				}
+
+				timer_next_tick.store(find_next_timer_tick(), std::memory_order_release);
+				expired.swap(timer_expired);
+				timer_task_count.fetch_sub(expired.size(), std::memory_order_relaxed);
+			} while (false);
+
+			for (size_t i = 0; i < expired.size(); i++) {
+				queue_task(expired[i].task, expired[i].priority);
+			}
+
+			bool ret = !expired.empty();
+			if (ret) {
+				// give the buffer back to avoid reallocation
+				expired.clear();
+				std::lock_guard<std::mutex> guard(timer_mutex);
+				if (timer_expired.empty()) {
+					timer_expired.swap(expired);
+				}
+			}
+
+			return ret;
+		}
+
+		static thread_index_t& get_current_thread_index_internal() noexcept {
+			return iris_static_instance_t<thread_index_t>::get_thread_local();
+		}
+
+		enum : uint32_t { thread_state_exited = 0, thread_state_running = 1, thread_state_retiring = 2 };
+
+		void spawn(size_t i) {
+			threads[i] = thread_t([this, i]() {
+				IRIS_PROFILE_THREAD("iris_async_worker", i);
+				thread_loop(i);
+			});
+		}
+
+		bool is_retiring() const noexcept {
+			size_t index = get_current_thread_index();
+			return index < internal_thread_count && thread_states && thread_states[index].load(std::memory_order_acquire) == thread_state_retiring;
+		}
+
+		static void cpu_relax() noexcept {
+#if defined(__i386__) || defined(__x86_64__)
+			__builtin_ia32_pause();
+#elif defined(__aarch64__)
+			__asm__ __volatile__("yield");
+#else
+			std::this_thread::yield();
+#endif
+		}
+
+		// wake up any parked thread, returns false if there is none
+		bool unpark_one() {
+			for (size_t i = 0; i < idle_mask_count; i++) {
+				uint64_t mask = idle_masks[i].load(std::memory_order_acquire);
+				while (mask != 0) {
+					uint64_t bit = uint64_t(1) << iris_get_trailing_zeros(mask);
+					// claim it, only one notifier wins
+					if (idle_masks[i].fetch_and(~bit, std::memory_order_acq_rel) & bit) {
+						park_slots[i * 64 + iris_get_trailing_zeros(bit)].notify();
+						return true;
+					}
+
+					mask = idle_masks[i].load(std::memory_order_acquire);
+				}
+			}
+
+			return false;
+		}
+
+		// wake up the given thread if it is parked
+		void unpark(size_t index) {
+			uint64_t bit = uint64_t(1) << (index & 63);
+			if (idle_masks[index / 64].fetch_and(~bit, std::memory_order_acq_rel) & bit) {
+				park_slots[index].notify();
+			}
+		}
+
+		// park current thread until notified, deadline reached or any task arrives
+		// threads out of the pool (without slots) wait on the shared condition variable instead
+		void park(timer_clock_t::time_point deadline, bool keep_timer) {
+			size_t index = get_current_thread_index();
+			if (!park_slots || index >= threads.size()) {
+				foreign_waiting_count.fetch_add(1, std::memory_order_acq_rel);
+				running_guard_t foreign_guard(foreign_waiting_count);
+				std::unique_lock<std::mutex> lock(mutex);
+				waiting_guard_t guard(this);
+
+				if (!has_task(waiting_thread_count.load(std::memory_order_acquire)) && !is_terminated()) {
+					uint64_t next_tick = keep_timer ? timer_next_tick.load(std::memory_order_acquire) : ~uint64_t(0);
+					if (next_tick != ~uint64_t(0)) {
+						deadline = std::min(deadline, timer_base + std::chrono::milliseconds(next_tick));
+					}
+
+					if (deadline == timer_clock_t::time_point::max()) {
+						condition.wait(lock);
+					} else {
+						condition.wait_until(lock, deadline);
+					}
+				}
+
+				return;
+			}
+
+			park_slot_t& slot = park_slots[index];
+			uint64_t bit = uint64_t(1) << (index & 63);
+			std::atomic<uint64_t>& idle_mask = idle_masks[index / 64];
+
+			waiting_guard_t guard(this);
+			slot.prepare();
+			idle_mask.fetch_or(bit, std::memory_order_seq_cst);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (!has_task(waiting_thread_count.load(std::memory_order_acquire)) && !is_terminated() && !is_retiring()) {
+				uint64_t next_tick = keep_timer ? timer_next_tick.load(std::memory_order_acquire) : ~uint64_t(0);
+				size_t keeper = ~size_t(0);
+				if (next_tick != ~uint64_t(0) && timer_keeper.compare_exchange_strong(keeper, index, std::memory_order_acq_rel)) {
+					// only one idle thread waits for the nearest timer
+					slot.wait(std::min(deadline, timer_base + std::chrono::milliseconds(next_tick)));
+					timer_keeper.store(~size_t(0), std::memory_order_release);
+					idle_mask.fetch_and(~bit, std::memory_order_acq_rel);
+
+					// let another idle thread take over timers while we are executing
+					if (waiting_thread_count.load(std::memory_order_acquire) > 1 && timer_next_tick.load(std::memory_order_acquire) != ~uint64_t(0)) {
+						wakeup_one();
+					}
+				} else {
+					slot.wait(deadline);
+				}
+			}
+
+			idle_mask.fetch_and(~bit, std::memory_order_acq_rel);
+			slot.finish();
+		}
+
+		// wake up at most count threads for tasks with given priority
+		void wakeup_with_priority(size_t priority, size_t count) {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			size_t n = 0;
+			while (n < count && waiting_thread_count.load(std::memory_order_acquire) > priority + limit_count + n && unpark_one()) {
+				n++;
+			}
+
+			if (n < count && foreign_waiting_count.load(std::memory_order_acquire) != 0) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (count - n == 1) {
+					condition.notify_one();
+				} else {
+					condition.notify_all();
+				}
+			}
 		}
 
 		void wakeup_one_with_priority(size_t priority) {
-			if (waiting_thread_count > priority + limit_count) {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waiting_thread_count.load(std::memory_order_acquire) > priority + limit_count) {
 				wakeup_one();
 			}
 		}
 
+		steal_deque_t& get_steal_deque(size_t thread_index, size_t priority) const noexcept {
+			return steal_deques[thread_index * priority_count + priority];
+		}
+
+		// take a task with exact priority: own deque first, then the injection queue, then steal from others
+		task_base_t* take_task(size_t priority) {
+			size_t thread_count = threads.size();
+			size_t current_thread_index = get_current_thread_index();
+			task_base_t* task = nullptr;
+			size_t k = 0;
+			if (current_thread_index < thread_count) {
+				task = get_steal_deque(current_thread_index, priority).steal();
+				k = 1;
+			} else {
+				current_thread_index = 0;
+			}
+
+			if (task == nullptr) {
+				task = inject_queues[priority].pop();
+			}
+
+			for (; task == nullptr && k < thread_count; k++) {
+				task = get_steal_deque((current_thread_index + k) % thread_count, priority).steal();
+			}
+
+			return task;
+		}
+
+		// any task with given priority, including tasks with deadlines and yielded tasks
+		bool has_task(size_t priority_size) const noexcept {
+			if (deadline_task_count.load(std::memory_order_acquire) != 0) {
+				for (size_t n = 0; n < std::min(priority_size, deadline_queue_count); n++) {
+					if (!deadline_queues[n].empty()) {
+						return true;
+					}
+				}
+			}
+
+			if (yield_task_count.load(std::memory_order_acquire) != 0) {
+				for (size_t n = 0; n < std::min(priority_size, deadline_queue_count); n++) {
+					if (!yield_queues[n].empty()) {
+						return true;
+					}
+				}
+			}
+
+			return fetch(priority_size).first != ~size_t(0);
+		}
+
+		// earliest deadline first, with given priority
+		bool poll_deadline(size_t priority_size) {
+			for (size_t n = 0; n < std::min(priority_size, deadline_queue_count); n++) {
+				timer_clock_t::time_point deadline;
+				task_base_t* task = deadline_queues[n].pop(deadline);
+				if (task != nullptr) {
+					deadline_task_count.fetch_sub(1, std::memory_order_relaxed);
+					if (!deadline_queues[n].empty()) {
+						wakeup_one_with_priority(n);
+					}
+
+					if (timer_clock_t::now() >= deadline) {
+						expired_task_count.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					execute_task(task);
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// yielded tasks with resume time not later than limit, earliest first
+		bool poll_yield(size_t priority_size, timer_clock_t::time_point limit) {
+			for (size_t n = 0; n < std::min(priority_size, deadline_queue_count); n++) {
+				timer_clock_t::time_point resume_time;
+				task_base_t* task = yield_queues[n].pop(resume_time, limit);
+				if (task != nullptr) {
+					yield_task_count.fetch_sub(1, std::memory_order_relaxed);
+					execute_task(task);
+					return true;
+				}
+			}
+
+			return false;
+		}
+
 		// try fetching a task with given priority
 		std::pair<size_t, size_t> fetch(size_t priority_size) const noexcept {
+			if constexpr (work_stealing) {
+				if (steal_deques) {
+					size_t thread_count = threads.size();
+					for (size_t n = 0; n < std::min(priority_size, priority_count); n++) {
+						if (!inject_queues[n].empty()) {
+							return std::make_pair(n, n);
+						}
+
+						for (size_t i = 0; i < thread_count; i++) {
+							if (!get_steal_deque(i, n).empty()) {
+								return std::make_pair(n, n);
+							}
+						}
+					}
+				}
+
+				return std::make_pair(~size_t(0), ~size_t(0));
+			}
+
 			size_t thread_count = threads.size();
 			if (thread_count != 0) {
 				size_t current_thread_index = get_current_thread_index();
 				current_thread_index = current_thread_index == ~size_t(0) ? 0 : current_thread_index;
+				// parked foreign threads may ask for more priorities than heads per row
+				priority_size = std::min(priority_size, thread_count);
 
 				for (size_t k = 0; k < task_head_duplicate_count; k++) {
 					size_t m = (k + current_thread_index) % task_head_duplicate_count;
 					for (size_t n = 0; n < priority_size; n++) {
 						size_t i = m * thread_count + n;
-						if (task_heads[i].load(std::memory_order_acquire) != nullptr) {
+						if (task_heads[i].value.load(std::memory_order_acquire) != nullptr) {
 							return std::make_pair(i, n);
 						}
 					}
@@ -1558,12 +2749,40 @@ namespace iris {
 		bool poll_one_internal(size_t priority_size) {
 			IRIS_PROFILE_SCOPE(__FUNCTION__);
 
+			if (deadline_task_count.load(std::memory_order_acquire) != 0 && poll_deadline(priority_size)) {
+				return true;
+			}
+
+			// yielded tasks go after the others, unless they have waited until their resume time
+			if (yield_task_count.load(std::memory_order_acquire) != 0 && poll_yield(priority_size, fetch(priority_size).first == ~size_t(0) ? timer_clock_t::time_point::max() : timer_clock_t::now())) {
+				return true;
+			}
+
+			if constexpr (work_stealing) {
+				if (steal_deques) {
+					for (size_t n = 0; n < std::min(priority_size, priority_count); n++) {
+						task_base_t* task = take_task(n);
+						if (task != nullptr) {
+							// more tasks left? wake up another thread to help
+							if (fetch(n + 1).first != ~size_t(0)) {
+								wakeup_one_with_priority(n);
+							}
+
+							execute_task(task);
+							return true;
+						}
+					}
+				}
+
+				return false;
+			}
+
 			std::pair<size_t, size_t> slot = fetch(priority_size);
 			size_t index = slot.first;
 
 			if (index != ~size_t(0)) {
 				size_t priority = slot.second;
-				std::atomic<task_base_t*>& task_head = task_heads[index];
+				std::atomic<task_base_t*>& task_head = task_heads[index].value;
 				if (task_head.load(std::memory_order_acquire) != nullptr) {
 					// fetch a task atomically
 					task_base_t* task = task_head.exchange(nullptr, std::memory_order_acquire);
@@ -1589,7 +2808,7 @@ namespace iris {
 							wakeup_one_with_priority(priority);
 						} else {
 							IRIS_ASSERT(!threads.empty());
-							if (waiting_thread_count > priority + limit_count) {
+							if (waiting_thread_count.load(std::memory_order_acquire) > priority + limit_count) {
 								if (fetch(priority_size).first != ~size_t(0)) {
 									wakeup_one_with_priority(priority);
 								}
@@ -1608,22 +2827,50 @@ namespace iris {
 		}
 
 	protected:
-		size_t& (*proxy_get_current_thread_index)();
+		thread_index_t& (*proxy_get_current_thread_index)();
 		large_task_allocator_t large_task_allocator;
 		task_allocator_t task_allocators[sub_allocator_count]; // default task allocator
 		std::vector<thread_t> threads; // worker
-		std::atomic<size_t> task_allocator_index; // index for selecting task allocator
-		std::atomic<size_t> running_count; // running_count
-		std::atomic<size_t> task_count; // the count of total waiting tasks 
-		std::vector<std::atomic<task_base_t*>> task_heads; // task pointer list
+		alignas(cache_line_size) std::atomic<size_t> running_count; // running_count, on its own cache line if padded
+		counter_shard_t task_counts[counter_shard_count]; // the count of total waiting tasks, see get_task_count()
+		std::vector<task_head_t> task_heads; // task pointer list
+		std::unique_ptr<steal_deque_t[]> steal_deques; // work stealing mode: thread_count * priority_count
+		std::unique_ptr<inject_queue_t[]> inject_queues; // work stealing mode: priority_count
+		size_t priority_count = 0;
+		std::unique_ptr<deadline_queue_t[]> deadline_queues; // deadline_queue_count, one per priority
+		size_t deadline_queue_count = 0;
+		std::atomic<size_t> deadline_task_count; // tasks in deadline queues
+		std::unique_ptr<deadline_queue_t[]> yield_queues; // yielded tasks by resume time, one per priority
+		std::atomic<size_t> yield_task_count; // tasks in yield queues
+		std::atomic<size_t> expired_task_count; // tasks with deadlines picked too late
+		std::unique_ptr<park_slot_t[]> park_slots; // one per thread
+		std::unique_ptr<std::atomic<uint64_t>[]> idle_masks; // bit is set if the thread is parked and not yet claimed by any notifier
+		size_t idle_mask_count = 0;
 		std::mutex mutex; // mutex to protect condition
-		std::condition_variable condition; // condition variable for idle wait
+		std::condition_variable condition; // condition variable for threads out of the pool
 		std::atomic<size_t> terminated; // is to terminate
-		size_t waiting_thread_count; // thread count of waiting on condition variable
+		std::atomic<size_t> waiting_thread_count; // thread count of parked
+		std::atomic<size_t> foreign_waiting_count; // thread count of waiting on condition variable
 		size_t limit_count; // limit the count of concurrently running thread
 		size_t internal_thread_count; // the count of internal thread
+		std::atomic<size_t> active_thread_count; // the count of running internal thread, see scale()
+		std::unique_ptr<std::atomic<uint32_t>[]> thread_states; // thread_state_*, indexed by internal thread
+		std::mutex scale_mutex;
 		size_t priority_task_threshold;
 		std::function<bool(task_base_t*, size_t&)> priority_task_handler;
+		std::function<void(size_t)> thread_init_handler;
+
+		std::mutex timer_mutex; // protects timer wheel
+		std::vector<timer_node_t> timer_slots[timer_wheel_levels][timer_wheel_size];
+		std::vector<timer_node_t> timer_overflow; // beyond the range of wheel
+		std::vector<timer_node_t> timer_cascading;
+		std::vector<timer_node_t> timer_expired;
+		size_t timer_level_counts[timer_wheel_levels];
+		uint64_t timer_current_tick; // ticks (ms) since timer_base
+		std::atomic<uint64_t> timer_next_tick; // nearest tick to wake up at, ~0 for none
+		std::atomic<size_t> timer_task_count; // delayed tasks in the wheel
+		timer_clock_t::time_point timer_base;
+		std::atomic<size_t> timer_keeper; // index of the idle thread waiting for timers, ~0 for none
 	};
 
 	template <typename async_worker_t>
@@ -1663,4 +2910,225 @@ namespace iris {
 		ptrdiff_t window_size;
 		std::atomic<ptrdiff_t> balance;
 	};
+
+	// scales running threads of async_worker by queue depth and sojourn time (queued -> started) of probe tasks
+	// a decision is made only if the same vote is given by enough sampling intervals in a row (hysteresis)
+	template <typename async_worker_t>
+	struct iris_async_scaler_t {
+		using scaler_clock_t = std::chrono::steady_clock;
+
+		struct config_t {
+			size_t min_thread_count = 1;
+			size_t max_thread_count = ~size_t(0);
+			std::chrono::milliseconds interval = std::chrono::milliseconds(100); // sampling interval
+			std::chrono::microseconds grow_sojourn = std::chrono::microseconds(5000); // vote for growing if sojourn time exceeds it
+			std::chrono::microseconds shrink_sojourn = std::chrono::microseconds(500); // vote for shrinking if sojourn time is below it and nothing queued
+			size_t grow_depth = 8; // vote for growing if queued tasks per running thread exceeds it
+			size_t grow_window = 3; // votes in a row to grow one thread
+			size_t shrink_window = 300; // votes in a row to shrink one thread
+		};
+
+		iris_async_scaler_t(async_worker_t& worker, const config_t& c) : async_worker(worker), config(c), probe(std::make_shared<probe_t>()) {
+			next_sample = scaler_clock_t::now() + config.interval;
+		}
+
+		// call it periodically, returns the count of running threads
+		size_t tick(scaler_clock_t::time_point now = scaler_clock_t::now()) {
+			size_t active_count = async_worker.get_active_thread_count();
+			if (now < next_sample || async_worker.is_terminated()) {
+				return active_count;
+			}
+
+			next_sample = now + config.interval;
+
+			// an outstanding probe tells us the sojourn time is at least its age
+			scaler_clock_t::rep queued = probe->queued.load(std::memory_order_acquire);
+			std::chrono::microseconds sojourn = std::chrono::microseconds(probe->sojourn.load(std::memory_order_acquire));
+			if (queued != 0) {
+				sojourn = std::max(sojourn, std::chrono::duration_cast<std::chrono::microseconds>(now - scaler_clock_t::time_point(scaler_clock_t::duration(queued))));
+			}
+
+			size_t timer_count = async_worker.get_timer_task_count();
+			size_t task_count = async_worker.get_task_count();
+			size_t depth = task_count > timer_count ? task_count - timer_count : 0;
+			last_sojourn = sojourn;
+			last_depth = depth;
+
+			if (sojourn >= config.grow_sojourn || depth > config.grow_depth * std::max(active_count, (size_t)1)) {
+				shrink_votes = 0;
+				if (++grow_votes >= config.grow_window) {
+					grow_votes = 0;
+					if (active_count < config.max_thread_count) {
+						active_count = async_worker.scale(active_count + 1);
+					}
+				}
+			} else if (sojourn <= config.shrink_sojourn && depth == 0) {
+				grow_votes = 0;
+				if (++shrink_votes >= config.shrink_window) {
+					shrink_votes = 0;
+					if (active_count > config.min_thread_count) {
+						active_count = async_worker.scale(active_count - 1);
+					}
+				}
+			} else {
+				grow_votes = shrink_votes = 0;
+			}
+
+			// send a new probe
+			if (queued == 0) {
+				scaler_clock_t::rep stamp = now.time_since_epoch().count();
+				probe->queued.store(stamp, std::memory_order_release);
+				async_worker.queue([p = probe, stamp]() {
+					p->sojourn.store(std::chrono::duration_cast<std::chrono::microseconds>(scaler_clock_t::now() - scaler_clock_t::time_point(scaler_clock_t::duration(stamp))).count(), std::memory_order_release);
+					p->queued.store(0, std::memory_order_release);
+				});
+			}
+
+			return active_count;
+		}
+
+		scaler_clock_t::time_point get_next_sample() const noexcept {
+			return next_sample;
+		}
+
+		std::chrono::microseconds get_last_sojourn() const noexcept {
+			return last_sojourn;
+		}
+
+		size_t get_last_depth() const noexcept {
+			return last_depth;
+		}
+
+	private:
+		// shared with the probe task, which may outlive the scaler
+		struct probe_t {
+			std::atomic<scaler_clock_t::rep> queued = 0; // zero if no probe in flight
+			std::atomic<typename std::chrono::microseconds::rep> sojourn = 0;
+		};
+
+		async_worker_t& async_worker;
+		config_t config;
+		std::shared_ptr<probe_t> probe;
+		scaler_clock_t::time_point next_sample;
+		std::chrono::microseconds last_sojourn = std::chrono::microseconds(0);
+		size_t last_depth = 0;
+		size_t grow_votes = 0;
+		size_t shrink_votes = 0;
+	};
+
+	// codel-style admission control by sojourn time (queued -> started) of probe tasks
+	// a queue is overloaded if the minimum sojourn time of a whole interval exceeds the target (a standing queue),
+	// and it recovers as soon as any sample is below the target.
+	// lifo stacks run the probe ahead of queued tasks, so its sojourn time is scaled by the queue depth there
+	template <typename async_worker_t>
+	struct iris_async_admission_t {
+		using admission_clock_t = std::chrono::steady_clock;
+
+		struct config_t {
+			std::chrono::microseconds target = std::chrono::microseconds(5000); // acceptable standing sojourn time
+			std::chrono::milliseconds interval = std::chrono::milliseconds(100); // window of the minimum sojourn time
+		};
+
+		iris_async_admission_t(async_worker_t& worker, const config_t& c) : async_worker(worker), config(c), probe(std::make_shared<probe_t>()) {
+			window_start = admission_clock_t::now();
+		}
+
+		// call it periodically, probes are sent one at a time, at most one per target time
+		void tick(admission_clock_t::time_point now = admission_clock_t::now()) {
+			if (async_worker.is_terminated()) {
+				return;
+			}
+
+			typename std::chrono::microseconds::rep sojourn = probe->sojourn.exchange(-1, std::memory_order_acq_rel);
+			if (sojourn >= 0) {
+				if constexpr (!async_worker_t::work_stealing) {
+					sojourn *= static_cast<typename std::chrono::microseconds::rep>(probe_depth + 1);
+				}
+
+				record(std::chrono::microseconds(sojourn), now);
+			}
+
+			// an outstanding probe tells us the sojourn time is at least its age
+			admission_clock_t::rep queued = probe->queued.load(std::memory_order_acquire);
+			if (queued != 0) {
+				std::chrono::microseconds age = std::chrono::duration_cast<std::chrono::microseconds>(now - admission_clock_t::time_point(admission_clock_t::duration(queued)));
+				if (age > config.target) {
+					record(age, now);
+				}
+			} else if (now >= next_probe) {
+				next_probe = now + std::max(config.target, std::chrono::microseconds(1000));
+				size_t timer_count = async_worker.get_timer_task_count();
+				size_t task_count = async_worker.get_task_count();
+				probe_depth = task_count > timer_count ? task_count - timer_count : 0;
+				admission_clock_t::rep stamp = now.time_since_epoch().count();
+				probe->queued.store(stamp, std::memory_order_release);
+				async_worker.queue([p = probe, stamp]() {
+					p->sojourn.store(std::chrono::duration_cast<std::chrono::microseconds>(admission_clock_t::now() - admission_clock_t::time_point(admission_clock_t::duration(stamp))).count(), std::memory_order_release);
+					p->queued.store(0, std::memory_order_release);
+				});
+			}
+		}
+
+		// feed a sojourn time measured elsewhere
+		void record(std::chrono::microseconds sojourn, admission_clock_t::time_point now = admission_clock_t::now()) {
+			last_sample = now;
+			last_sojourn = sojourn;
+			window_min = std::min(window_min, sojourn);
+
+			if (now >= window_start + config.interval) {
+				standing_sojourn = window_min;
+				window_min = std::chrono::microseconds::max();
+				window_start = now;
+			}
+		}
+
+		// false if the standing sojourn time and the latest sample both exceed target, a stale state always admits
+		bool admit(std::chrono::microseconds target, admission_clock_t::time_point now = admission_clock_t::now()) noexcept {
+			if (standing_sojourn > target && last_sojourn > target && now - last_sample <= config.interval) {
+				rejected_count++;
+				return false;
+			} else {
+				return true;
+			}
+		}
+
+		bool admit(admission_clock_t::time_point now = admission_clock_t::now()) noexcept {
+			return admit(config.target, now);
+		}
+
+		const config_t& get_config() const noexcept {
+			return config;
+		}
+
+		std::chrono::microseconds get_standing_sojourn() const noexcept {
+			return standing_sojourn;
+		}
+
+		std::chrono::microseconds get_last_sojourn() const noexcept {
+			return last_sojourn;
+		}
+
+		size_t get_rejected_count() const noexcept {
+			return rejected_count;
+		}
+
+	private:
+		// shared with the probe task, which may outlive the admission
+		struct probe_t {
+			std::atomic<admission_clock_t::rep> queued = 0; // zero if no probe in flight
+			std::atomic<typename std::chrono::microseconds::rep> sojourn = -1; // negative if consumed
+		};
+
+		async_worker_t& async_worker;
+		config_t config;
+		std::shared_ptr<probe_t> probe;
+		admission_clock_t::time_point next_probe;
+		size_t probe_depth = 0;
+		admission_clock_t::time_point window_start;
+		admission_clock_t::time_point last_sample;
+		std::chrono::microseconds window_min = std::chrono::microseconds::max();
+		std::chrono::microseconds standing_sojourn = std::chrono::microseconds(0);
+		std::chrono::microseconds last_sojourn = std::chrono::microseconds(0);
+		size_t rejected_count = 0;
+	};
 }
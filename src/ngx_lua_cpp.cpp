@@ -27,6 +27,7 @@ SOFTWARE.
 
 #include "ngx_lua_cpp.h"
 #include "iris/iris_common.inl"
+#include <bit>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -34,14 +35,42 @@ SOFTWARE.
 #include <windows.h>
 #else
 #include <dlfcn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+#include <sys/event.h>
+#else
+#include <poll.h>
+#endif
 #endif
 
 namespace iris {
 	int ngx_iris_wrap_coroutine_with_returns_key;
+	// qos lanes of lua coroutines, see ngx_lua_cpp_t::get_qos_priority()
+	static constexpr size_t ngx_qos_interactive = 0;
+	static constexpr size_t ngx_qos_default = 1;
+	static constexpr size_t ngx_qos_batch = 2;
 	// minimal forward declaration, modify if nginx header changes
 	using ngx_int_t = int;
 	using ngx_uint_t = unsigned int;
 	using ngx_msec_t = uintptr_t;
+	using ngx_fd_t = int;
+	static constexpr ngx_int_t ngx_ok = 0;
+	static constexpr ngx_msec_t ngx_timer_infinite = ~ngx_msec_t(0);
+	// NGX_READ_EVENT depends on the event method of the platform
+#if defined(__linux__)
+	static constexpr ngx_int_t ngx_read_event = EPOLLIN | EPOLLRDHUP;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+	static constexpr ngx_int_t ngx_read_event = EVFILT_READ;
+#elif !defined(_WIN32)
+	static constexpr ngx_int_t ngx_read_event = POLLIN;
+#endif
 	struct ngx_event_t;
 	struct ngx_connection_t;
 	struct ngx_cycle_t;
@@ -79,8 +108,27 @@ namespace iris {
 		// ...
 	};
 
-	struct ngx_http_lua_co_ctx_t;
-	struct ngx_stream_lua_co_ctx_t;
+	typedef void (*ngx_http_cleanup_pt)(void* data);
+
+	struct ngx_http_lua_co_ctx_t {
+		void* data;
+		lua_State* co;
+		ngx_http_lua_co_ctx_t* parent_co_ctx;
+		void* zombie_child_threads;
+		void** next_zombie_child_thread;
+		ngx_http_cleanup_pt cleanup;
+		// ...
+	};
+
+	struct ngx_stream_lua_co_ctx_t {
+		void* data;
+		lua_State* co;
+		ngx_stream_lua_co_ctx_t* parent_co_ctx;
+		void* zombie_child_threads;
+		void** next_zombie_child_thread;
+		ngx_stream_lua_cleanup_pt cleanup;
+		// ...
+	};
 	struct ngx_http_lua_ctx_t;
 	struct ngx_stream_lua_ctx_t;
 
@@ -114,6 +162,15 @@ namespace iris {
 		x->prev->next = x->next;
 	}
 
+	static void ngx_queue_init(ngx_queue_t* q) {
+		q->prev = q;
+		q->next = q;
+	}
+
+	static bool ngx_queue_empty(const ngx_queue_t* h) {
+		return h == h->prev;
+	}
+
 	// let's go
 	struct ngx_hooker_t {
 		static ngx_hooker_t& get_instance() {
@@ -148,6 +205,7 @@ namespace iris {
 			get_proc_address(ngx_stream_lua_module, host, "ngx_stream_lua_module");
 			get_proc_address(ngx_http_lua_get_co_ctx, host, "ngx_http_lua_get_co_ctx");
 			get_proc_address(ngx_stream_lua_get_co_ctx, host, "ngx_stream_lua_get_co_ctx");
+			get_proc_address(ngx_add_channel_event, host, "ngx_add_channel_event");
 
 			prev_ngx_process_events = actions->process_events;
 			actions->process_events = &ngx_hooker_t::proxy_ngx_process_events;
@@ -159,28 +217,124 @@ namespace iris {
 				return lua_gettop(L);
 			}
 
-			lua_pushlightuserdata(L, L);
-			lua_rawget(L, LUA_REGISTRYINDEX);
-			if (lua_isnil(L, -1)) {
+			return ngx_hooker_t::get_instance().fetch_coroutine_returns(L);
+		}
+
+		// returns of a resumed coroutine waiting for the lua wrapper, with timestamps of the call
+		struct pending_return_t {
+			int slot = 0;
+			int count = 0;
+			ngx_binding_stats_t* stats = nullptr;
+			std::chrono::steady_clock::time_point queued;
+			std::chrono::steady_clock::time_point started;
+			std::chrono::steady_clock::time_point completed;
+		};
+
+		// returns of a finished coroutine are kept in a pooled slot table until the wrapper fetches them
+		void store_coroutine_returns(lua_State* L, int nrets, const pending_return_t& timing) {
+			lua_checkstack(L, 4);
+			vm_state_t& vm = get_vm_state(L);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, vm.return_slots_ref);
+
+			int slot = 0;
+			auto it = iris_binary_find(pending_returns.begin(), pending_returns.end(), L);
+			if (it != pending_returns.end()) {
+				// never fetched (coroutine aborted), reuse its slot
+				slot = it->second.slot;
+				it->second = timing;
+				it->second.slot = slot;
+				it->second.count = nrets;
+			} else {
+				if (!vm.free_return_slots.empty()) {
+					slot = vm.free_return_slots.back();
+					vm.free_return_slots.pop_back();
+				} else {
+					slot = static_cast<int>(++vm.return_slot_count);
+					lua_createtable(L, nrets, 0);
+					lua_rawseti(L, -2, slot);
+				}
+
+				pending_return_t pending = timing;
+				pending.slot = slot;
+				pending.count = nrets;
+				iris_binary_insert(pending_returns, iris_make_key_value(L, pending));
+			}
+
+			lua_rawgeti(L, -1, slot);
+			for (int i = 1; i <= nrets; i++) {
+				lua_pushvalue(L, i);
+				lua_rawseti(L, -2, i);
+			}
+
+			lua_pop(L, 2 + nrets);
+		}
+
+		int fetch_coroutine_returns(lua_State* L) {
+			auto it = iris_binary_find(pending_returns.begin(), pending_returns.end(), L);
+			if (it == pending_returns.end()) {
 				return luaL_error(L, "No coroutine return value collected!");
 			}
 
-			lua_pushlightuserdata(L, L);
-			lua_pushnil(L);
-			lua_rawset(L, LUA_REGISTRYINDEX);
+			int slot = it->second.slot;
+			int nrets = it->second.count;
+			if (it->second.stats != nullptr) {
+				it->second.stats->record(it->second.queued, it->second.started, it->second.completed, std::chrono::steady_clock::now());
+			}
 
-			int table_index = lua_absindex(L, -1);
-			lua_rawgeti(L, table_index, 1);
-			int nrets = lua_tointeger(L, -1);
-			lua_pop(L, 1);
+			pending_returns.erase(it);
+
+			lua_checkstack(L, nrets + 4);
+			vm_state_t& vm = get_vm_state(L);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, vm.return_slots_ref);
+			lua_rawgeti(L, -1, slot);
+			int table_index = lua_gettop(L);
 
 			for (int i = 1; i <= nrets; i++) {
-				lua_rawgeti(L, table_index, i + 1);
+				lua_rawgeti(L, table_index, i);
+				lua_pushnil(L);
+				lua_rawseti(L, table_index, i);
 			}
 
+			vm.free_return_slots.push_back(slot);
 			return nrets;
 		}
 
+		// registry refs and pooled return slots of a lua vm, the http and stream subsystems have their own.
+		// vms of nginx live as long as the worker process
+		struct vm_state_t {
+			int return_slots_ref = LUA_NOREF;
+			size_t return_slot_count = 0;
+			std::vector<int> free_return_slots;
+			lua_State* gc_state = nullptr; // anchored thread for idle gc stepping, the registering coroutine may be collected later
+			int gc_thread_ref = LUA_NOREF;
+			int tagged_threads_ref = LUA_NOREF;
+			int anchors_ref = LUA_NOREF;
+		};
+
+		// found by the address of vm_states in the registry of the vm, created on first use
+		vm_state_t& get_vm_state(lua_State* L) {
+			lua_pushlightuserdata(L, &vm_states);
+			lua_rawget(L, LUA_REGISTRYINDEX);
+			vm_state_t* vm = static_cast<vm_state_t*>(lua_touserdata(L, -1));
+			lua_pop(L, 1);
+
+			if (vm == nullptr) {
+				std::unique_ptr<vm_state_t> state = std::make_unique<vm_state_t>();
+				vm = state.get();
+				lua_newtable(L);
+				vm->return_slots_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+				vm->gc_state = lua_newthread(L);
+				vm->gc_thread_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+				lua_pushlightuserdata(L, &vm_states);
+				lua_pushlightuserdata(L, vm);
+				lua_rawset(L, LUA_REGISTRYINDEX);
+				vm_states.emplace_back(std::move(state));
+			}
+
+			return *vm;
+		}
+
 		void registar(iris_lua_t lua) {
 			const std::string_view wrapper = 
 				"local get_coroutine_returns = ..."
@@ -192,6 +346,8 @@ namespace iris {
 			lua.set_registry(static_cast<const void*>(&ngx_iris_wrap_coroutine_with_returns_key), lua.call<iris_lua_t::ref_t>(lua.load(wrapper, "=(ngx_lua_cpp)"), &get_coroutine_returns));
 
 			lua_State* L = lua.get_state();
+			get_vm_state(L);
+
 			lua_getglobal(L, "ngx");
 			lua_getfield(L, -1, "config");
 			if (lua_istable(L, -1)) {
@@ -207,6 +363,228 @@ namespace iris {
 			}
 		}
 
+		// tag closures of bindings in the type table with the index of their names, so lua_method_begin() can tell which one is invoked.
+		// the index is placed at the first upvalue, which is free or a placeholder unless the binding is overloaded
+		void register_bindings(lua_State* L, int type_index) {
+			type_index = lua_absindex(L, type_index);
+
+			lua_pushnil(L);
+			while (lua_next(L, type_index) != 0) {
+				if (lua_type(L, -2) == LUA_TSTRING && lua_isfunction(L, -1)) {
+					std::string name = lua_tostring(L, -2);
+					size_t index = std::find(binding_names.begin(), binding_names.end(), name) - binding_names.begin();
+					if (index == binding_names.size()) {
+						binding_names.emplace_back(std::move(name));
+					}
+
+					if (lua_iscfunction(L, -1)) {
+						if (tag_binding(L, index)) {
+							lua_pushvalue(L, -2);
+							lua_pushvalue(L, -2);
+							lua_rawset(L, type_index);
+						}
+					} else if (lua_getupvalue(L, -1, 1) != nullptr) {
+						// wrapped by ngx_iris_wrap_coroutine_with_returns_key, tag the inner binding. other lua functions (e.g. run_keyed) are skipped
+						bool wrapped = lua_tocfunction(L, -1) == &ngx_hooker_t::get_coroutine_returns;
+						lua_pop(L, 1);
+
+						if (wrapped && lua_getupvalue(L, -1, 2) != nullptr) {
+							if (lua_iscfunction(L, -1) && tag_binding(L, index)) {
+								lua_setupvalue(L, -2, 2);
+							} else {
+								lua_pop(L, 1);
+							}
+						}
+					}
+				}
+
+				lua_pop(L, 1);
+			}
+		}
+
+		// tag the cfunction on the top, returns true if it is replaced by a new closure.
+		// closures with environments have a null placeholder at the first upvalue, others (overload chains, proxies) are left untagged
+		static bool tag_binding(lua_State* L, size_t index) {
+			if (lua_getupvalue(L, -1, 1) == nullptr) {
+				lua_CFunction func = lua_tocfunction(L, -1);
+				lua_pushinteger(L, static_cast<lua_Integer>(index));
+				lua_pushcclosure(L, func, 1);
+				lua_replace(L, -2);
+				return true;
+			}
+
+			bool placeholder = lua_isnil(L, -1) || (lua_islightuserdata(L, -1) && lua_touserdata(L, -1) == nullptr) || lua_type(L, -1) == LUA_TNUMBER;
+			lua_pop(L, 1);
+			if (placeholder) {
+				lua_pushinteger(L, static_cast<lua_Integer>(index));
+				lua_setupvalue(L, -2, 1);
+			}
+
+			return false;
+		}
+
+		// called from the closure of the binding
+		static size_t resolve_binding(lua_State* L) noexcept {
+			return lua_type(L, lua_upvalueindex(1)) == LUA_TNUMBER ? static_cast<size_t>(lua_tointeger(L, lua_upvalueindex(1))) : ~size_t(0);
+		}
+
+		// tag the running lua coroutine (usually a request) with a qos lane, kept until the coroutine is collected
+		void set_qos(lua_State* L, size_t lane) {
+			acquire_thread_tags(L).qos = lane;
+		}
+
+		// tags of a lua coroutine, untagged coroutines are answered without touching lua.
+		// a record is checked against the weak table only if there is one, since a collected coroutine may leave it to a new one at the same address
+		struct thread_tags_t {
+			const vm_state_t* vm = nullptr;
+			lua_Integer serial = 0;
+			size_t qos = ngx_qos_default;
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+			std::string tenant; // by name, tenants are indexed per instance
+		};
+
+		const thread_tags_t* find_thread_tags(lua_State* L) {
+			if (thread_tags.empty()) {
+				return nullptr;
+			}
+
+			auto it = iris_binary_find(thread_tags.begin(), thread_tags.end(), L);
+			if (it == thread_tags.end()) {
+				return nullptr;
+			} else if (get_thread_serial(L) != it->second.serial) {
+				thread_tags.erase(it);
+				return nullptr;
+			} else {
+				return &it->second;
+			}
+		}
+
+		thread_tags_t& acquire_thread_tags(lua_State* L) {
+			auto it = iris_binary_find(thread_tags.begin(), thread_tags.end(), L);
+			if (it != thread_tags.end() && get_thread_serial(L) == it->second.serial) {
+				return it->second;
+			}
+
+			vm_state_t& vm = get_vm_state(L);
+			if (vm.tagged_threads_ref == LUA_NOREF) {
+				lua_newtable(L);
+				lua_newtable(L);
+				lua_pushliteral(L, "k");
+				lua_setfield(L, -2, "__mode");
+				lua_setmetatable(L, -2);
+				vm.tagged_threads_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+			}
+
+			if (it == thread_tags.end() && thread_tags.size() >= thread_tags_prune_size) {
+				prune_thread_tags(L);
+			}
+
+			thread_tags_t tags;
+			tags.vm = &vm;
+			tags.serial = ++thread_tag_serial;
+			lua_rawgeti(L, LUA_REGISTRYINDEX, vm.tagged_threads_ref);
+			lua_pushthread(L);
+			lua_pushinteger(L, tags.serial);
+			lua_rawset(L, -3);
+			lua_pop(L, 1);
+
+			return iris_binary_insert(thread_tags, iris_make_key_value(L, tags))->second;
+		}
+
+		lua_Integer get_thread_serial(lua_State* L) {
+			int tagged_threads_ref = get_vm_state(L).tagged_threads_ref;
+			if (tagged_threads_ref == LUA_NOREF) {
+				return 0;
+			}
+
+			lua_rawgeti(L, LUA_REGISTRYINDEX, tagged_threads_ref);
+			lua_pushthread(L);
+			lua_rawget(L, -2);
+			lua_Integer serial = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : 0;
+			lua_pop(L, 2);
+
+			return serial;
+		}
+
+		// drop records of collected coroutines of the vm, records of other vms are kept
+		void prune_thread_tags(lua_State* L) {
+			const vm_state_t& vm = get_vm_state(L);
+			std::vector<iris_key_value_t<lua_State*, thread_tags_t>> alive;
+			for (const auto& record : thread_tags) {
+				if (record.second.vm != &vm) {
+					alive.emplace_back(record);
+				}
+			}
+
+			lua_rawgeti(L, LUA_REGISTRYINDEX, vm.tagged_threads_ref);
+			lua_pushnil(L);
+			while (lua_next(L, -2) != 0) {
+				auto it = iris_binary_find(thread_tags.begin(), thread_tags.end(), lua_tothread(L, -2));
+				if (it != thread_tags.end() && it->second.vm == &vm && it->second.serial == lua_tointeger(L, -1)) {
+					alive.emplace_back(std::move(*it));
+				}
+
+				lua_pop(L, 1);
+			}
+
+			lua_pop(L, 1);
+			std::sort(alive.begin(), alive.end());
+			thread_tags = std::move(alive);
+			thread_tags_prune_size = std::max(thread_tags.size() * 2, size_t(64));
+		}
+
+		// tag the running lua coroutine with a deadline, time_point::max() to remove it
+		void set_deadline(lua_State* L, std::chrono::steady_clock::time_point deadline) {
+			acquire_thread_tags(L).deadline = deadline;
+		}
+
+		// tag the running lua coroutine with a tenant
+		void set_tenant(lua_State* L, std::string_view tenant) {
+			acquire_thread_tags(L).tenant = tenant;
+		}
+
+		size_t get_expired_call_count() const noexcept {
+			return expired_call_count;
+		}
+
+		// settings and statistics of idle gc stepping
+		struct idle_gc_t {
+			size_t step_size = 0;
+			std::chrono::microseconds time_budget = std::chrono::microseconds(0);
+			size_t step_count = 0;
+			size_t cycle_count = 0;
+			std::chrono::microseconds time_spent = std::chrono::microseconds(0);
+		};
+
+		idle_gc_t& get_idle_gc() noexcept {
+			return idle_gc;
+		}
+
+		// keep the value at value_index alive as long as the object at object_index
+		void anchor(lua_State* L, int object_index, int value_index) {
+			object_index = lua_absindex(L, object_index);
+			value_index = lua_absindex(L, value_index);
+			vm_state_t& vm = get_vm_state(L);
+			if (vm.anchors_ref == LUA_NOREF) {
+				lua_newtable(L);
+				lua_newtable(L);
+				lua_pushliteral(L, "k");
+				lua_setfield(L, -2, "__mode");
+				lua_setmetatable(L, -2);
+				vm.anchors_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+			}
+
+			lua_rawgeti(L, LUA_REGISTRYINDEX, vm.anchors_ref);
+			lua_pushvalue(L, object_index);
+			lua_pushvalue(L, value_index);
+			lua_rawset(L, -3);
+			lua_pop(L, 1);
+		}
+
+		const std::vector<std::string>& get_binding_names() const noexcept {
+			return binding_names;
+		}
+
 		void insert(ngx_lua_cpp_t* bridge) {
 			iris::iris_binary_insert(cpp_list, bridge);
 		}
@@ -220,7 +598,15 @@ namespace iris {
 
 		void notify() {
 			if (notified.exchange(1, std::memory_order_relaxed) == 0) {
-				if (actions->notify != nullptr) {
+				int fd = notify_fd.load(std::memory_order_acquire);
+				if (fd != -1) {
+#ifdef __linux__
+					uint64_t value = 1;
+#else
+					uint8_t value = 1;
+#endif
+					[[maybe_unused]] auto ret = ::write(fd, &value, sizeof(value));
+				} else if (actions->notify != nullptr) {
 					actions->notify(&ngx_hooker_t::ngx_event_handler);
 				}
 			}
@@ -273,65 +659,256 @@ namespace iris {
 			return is_http;
 		}
 
-		int ngx_lua_cpp_yield(lua_State* L, int narg) {
-			int (*func)(lua_State*) = nullptr;
+		// pooled record of a pending coroutine call, resolved once when the binding starts
+		struct call_context_t {
+			lua_State* L = nullptr;
+			void* co_ctx = nullptr; // reset to nullptr if the request is aborted
+			ngx_queue_t* event_queue = nullptr;
+			iris_cancel_token_t cancel_token;
+			ngx_call_trace_t trace;
+			bool is_stream = false;
+			bool yielded = false;
+			bool completed = false; // the coroutine has completed after yielding
+		};
+
+		call_context_t* acquire_call_context(lua_State* L, bool is_stream) {
+			void* co_ctx = is_stream ? static_cast<void*>(get_stream_co_ctx(L)) : static_cast<void*>(get_http_co_ctx(L));
+			call_context_t* context = nullptr;
+			if (free_call_contexts.empty()) {
+				call_contexts.emplace_back(std::make_unique<call_context_t>());
+				context = call_contexts.back().get();
+			} else {
+				context = free_call_contexts.back();
+				free_call_contexts.pop_back();
+			}
 
-			if (is_http_context(L)) {
-				ngx_http_lua_co_ctx_t* http_lua_co_ctx = get_http_co_ctx(L);
-				if (http_lua_co_ctx != nullptr) {
-					func = require_ngx_sleep(L, http_lua_co_ctx, ngx_http_lua_yield, offset_http_co_ctx_event_queue);
-					pending_lua_http_co_ctxs.push_back(http_lua_co_ctx);
+			context->L = L;
+			context->co_ctx = co_ctx;
+			context->event_queue = nullptr;
+			context->cancel_token.reset();
+			context->trace.stats = nullptr;
+			context->trace.time_slice = std::chrono::microseconds::max();
+			context->is_stream = is_stream;
+			context->yielded = false;
+			context->completed = false;
+			return context;
+		}
+
+		void release_call_context(call_context_t* context) {
+			free_call_contexts.push_back(context);
+		}
+
+		void begin_call(lua_State* L, bool is_stream, size_t priority, std::chrono::steady_clock::time_point deadline, iris_cancel_token_t::gate_t* gate) {
+			if (current_call != nullptr) {
+				// a call left here raised errors before its coroutine was created, a created one always completes or yields
+				release_call_context(current_call);
+			}
+
+			current_call = acquire_call_context(L, is_stream);
+			current_call->cancel_token.set_deadline(deadline);
+			current_call->cancel_token.set_gate(gate);
+
+			// coroutines created by this binding pick up the token
+			iris_cancel_token_t::get_current() = &current_call->cancel_token;
+			iris_priority_t::get_current() = priority;
+		}
+
+		ngx_call_trace_t* get_current_trace() noexcept {
+			return current_call != nullptr ? &current_call->trace : nullptr;
+		}
+
+		void end_call(lua_State* L) {
+			// the token of the completing coroutine is current here
+			iris_cancel_token_t* token = iris_cancel_token_t::get_current();
+			if (current_call != nullptr && current_call->L == L && &current_call->cancel_token == token) {
+				// completed without yielding, yielded calls are released on resuming
+				ngx_call_trace_t& trace = current_call->trace;
+				if (trace.stats != nullptr) {
+					auto now = std::chrono::steady_clock::now();
+					trace.stats->record(trace.queued, current_call->cancel_token.get_started(), now, now);
+				}
+
+				iris_cancel_token_t::get_current() = nullptr;
+				iris_priority_t::get_current() = ~size_t(0);
+				release_call_context(current_call);
+				current_call = nullptr;
+			} else if (token != nullptr) {
+				// completed after yielding
+				auto it = iris_binary_find(pending_calls.begin(), pending_calls.end(), L);
+				if (it != pending_calls.end() && &it->second->cancel_token == token) {
+					it->second->completed = true;
 				} else {
-					return luaL_error(L, "Unexpected ngx_lua_cpp http context");
+					auto abandoned = std::find_if(abandoned_calls.begin(), abandoned_calls.end(), [token](call_context_t* context) {
+						return &context->cancel_token == token;
+					});
+
+					if (abandoned != abandoned_calls.end()) {
+						release_call_context(*abandoned);
+						*abandoned = abandoned_calls.back();
+						abandoned_calls.pop_back();
+					}
 				}
+			}
+		}
+
+		// the coroutine of the context is still running, recycle it when the coroutine completes (see end_call())
+		void abandon_call_context(call_context_t* context) {
+			context->cancel_token.cancel();
+			if (context->completed) {
+				release_call_context(context);
 			} else {
-				ngx_stream_lua_co_ctx_t* stream_lua_co_ctx = get_stream_co_ctx(L); // assuming no stream request
-				if (stream_lua_co_ctx != nullptr) {
-					func = require_ngx_sleep(L, stream_lua_co_ctx, ngx_stream_lua_yield, offset_stream_co_ctx_event_queue);
-					pending_stream_http_co_ctxs.push_back(stream_lua_co_ctx);
-				} else {
-					return luaL_error(L, "Unexpected ngx_lua_cpp stream context");
+				abandoned_calls.emplace_back(context);
+			}
+		}
+
+		void drop_call_context(call_context_t* context, bool traced) {
+			if (traced) {
+				abandon_call_context(context);
+			} else {
+				release_call_context(context);
+			}
+		}
+
+		template <typename co_ctx_t>
+		void hook_cleanup(call_context_t* context, void (*&sleep_cleanup)(void* data)) {
+			// ngx.sleep() has installed its cleanup, chain it to cancel our coroutine when the request is aborted
+			co_ctx_t* co_ctx = static_cast<co_ctx_t*>(context->co_ctx);
+			if (co_ctx->co == context->L && co_ctx->cleanup != nullptr && co_ctx->cleanup != &ngx_hooker_t::ngx_cleanup_handler<co_ctx_t>) {
+				sleep_cleanup = co_ctx->cleanup;
+				co_ctx->cleanup = &ngx_hooker_t::ngx_cleanup_handler<co_ctx_t>;
+			}
+		}
+
+		template <typename co_ctx_t>
+		static void ngx_cleanup_handler(void* data) {
+			ngx_hooker_t& hooker = ngx_hooker_t::get_instance();
+			hooker.cancel_call(static_cast<co_ctx_t*>(data)->co, data);
+
+			// always chain to ngx.sleep() cleanup, the placeholder event may be posted already
+			if constexpr (std::is_same_v<co_ctx_t, ngx_http_lua_co_ctx_t>) {
+				hooker.http_sleep_cleanup(data);
+			} else {
+				hooker.stream_sleep_cleanup(data);
+			}
+		}
+
+		void cancel_call(lua_State* L, void* co_ctx) {
+			auto it = iris_binary_find(pending_calls.begin(), pending_calls.end(), L);
+			if (it != pending_calls.end() && it->second->co_ctx == co_ctx) {
+				call_context_t* context = it->second;
+				context->cancel_token.cancel();
+				context->co_ctx = nullptr;
+			}
+		}
+
+		int ngx_lua_cpp_yield(lua_State* L, int narg) {
+			call_context_t* context = current_call;
+			current_call = nullptr;
+			iris_cancel_token_t::get_current() = nullptr;
+			iris_priority_t::get_current() = ~size_t(0);
+
+			// the coroutine of a binding picked up the token of its context in lua_method_begin()
+			bool traced = context != nullptr && context->L == L;
+			if (!traced) {
+				// bindings without lua_method_begin(), a context left by a failed call is not referenced
+				if (context != nullptr) {
+					release_call_context(context);
 				}
+
+				context = acquire_call_context(L, !is_http_context(L));
+			}
+
+			if (context->co_ctx == nullptr) {
+				drop_call_context(context, traced);
+				return luaL_error(L, context->is_stream ? "Unexpected ngx_lua_cpp stream context" : "Unexpected ngx_lua_cpp http context");
+			}
+
+			int offset = 0;
+			int (*func)(lua_State*) = nullptr;
+			if (context->is_stream) {
+				func = require_ngx_sleep(L, context->co_ctx, ngx_stream_lua_yield, offset_stream_co_ctx_event_queue);
+				offset = offset_stream_co_ctx_event_queue;
+			} else {
+				func = require_ngx_sleep(L, context->co_ctx, ngx_http_lua_yield, offset_http_co_ctx_event_queue);
+				offset = offset_http_co_ctx_event_queue;
+			}
+
+			if (func == nullptr) {
+				drop_call_context(context, traced);
+				return luaL_error(L, "Unable to locate ngx.sleep placeholder event");
 			}
 
+			context->event_queue = reinterpret_cast<ngx_queue_t*>(reinterpret_cast<uintptr_t>(context->co_ctx) + offset);
+			context->yielded = true;
+
+			// ngx.sleep(0) installs the resume handler and posts a placeholder event, then yields
 			lua_settop(L, 0);
 			lua_pushnumber(L, 0.0);
-			return func(L);
-		}
+			int ret = func(L);
 
-		int ngx_lua_cpp_resume(lua_State* L, int nrets) {
-			ngx_queue_t* p = nullptr;
-			if (is_http_context(L)) {
-				ngx_http_lua_co_ctx_t* http_lua_co_ctx = get_http_co_ctx(L);
-				if (http_lua_co_ctx != nullptr) {
-					p = reinterpret_cast<ngx_queue_t*>(reinterpret_cast<uintptr_t>(http_lua_co_ctx) + offset_http_co_ctx_event_queue);
-				} else {
-					return LUA_ERRERR;
-				}
+			// take the placeholder out of ngx_posted_delayed_events right now, ngx_lua_cpp_resume() posts it again.
+			// keep it self-linked so that the cleanup of an aborted request can still unlink it safely.
+			ngx_queue_remove(context->event_queue);
+			ngx_queue_init(context->event_queue);
+
+			if (context->is_stream) {
+				hook_cleanup<ngx_stream_lua_co_ctx_t>(context, stream_sleep_cleanup);
 			} else {
-				ngx_stream_lua_co_ctx_t* stream_lua_co_ctx = get_stream_co_ctx(L);
-				if (stream_lua_co_ctx != nullptr) {
-					p = reinterpret_cast<ngx_queue_t*>(reinterpret_cast<uintptr_t>(stream_lua_co_ctx) + offset_stream_co_ctx_event_queue);
-				} else {
-					return LUA_ERRERR;
-				}
+				hook_cleanup<ngx_http_lua_co_ctx_t>(context, http_sleep_cleanup);
+			}
+
+			auto it = iris_binary_find(pending_calls.begin(), pending_calls.end(), L);
+			if (it != pending_calls.end()) {
+				// stale record of an aborted coroutine on a recycled lua_State
+				abandon_call_context(it->second);
+				it->second = context;
+			} else {
+				iris_binary_insert(pending_calls, iris_make_key_value(L, context));
 			}
 
-			ngx_queue_insert_tail(ngx_posted_delayed_events, p);
+			return ret;
+		}
 
-			if (nrets != 0) {
-				lua_pushlightuserdata(L, L);
-				lua_createtable(L, nrets + 1, 0);
-				lua_pushinteger(L, nrets);
-				lua_rawseti(L, -2, 1);
+		int ngx_lua_cpp_resume(lua_State* L, int nrets) {
+			auto it = iris_binary_find(pending_calls.begin(), pending_calls.end(), L);
+			if (it == pending_calls.end()) {
+				return LUA_ERRERR;
+			}
 
-				for (int i = 1; i <= nrets; i++) {
-					lua_pushvalue(L, i);
-					lua_rawseti(L, -2, i + 1);
-				}
+			call_context_t* context = it->second;
+			pending_calls.erase(it);
+			bool aborted = context->co_ctx == nullptr;
+			// cancelled calls are aborted or expired, report the expired ones only if some work was skipped
+			bool expired = !aborted && context->cancel_token.is_skipped();
+			if (!aborted) {
+				ngx_queue_insert_tail(ngx_posted_delayed_events, context->event_queue);
+			}
 
-				lua_rawset(L, LUA_REGISTRYINDEX);
+			pending_return_t timing;
+			timing.stats = context->trace.stats;
+			timing.queued = context->trace.queued;
+			timing.started = context->cancel_token.get_started();
+			timing.completed = std::chrono::steady_clock::now();
+			release_call_context(context);
+
+			if (expired) {
+				// returns of the skipped work are meaningless, void bindings return nil, "timeout" too
+				expired_call_count++;
 				lua_pop(L, nrets);
+				lua_pushnil(L);
+				lua_pushliteral(L, "timeout");
+				nrets = 2;
+			}
+
+			if (aborted) {
+				// request is gone, drop the returns
+				lua_settop(L, 0);
+			} else if (nrets != 0) {
+				// recorded when the lua wrapper fetches returns
+				store_coroutine_returns(L, nrets, timing);
+			} else if (timing.stats != nullptr) {
+				// nothing returned to fetch, the resume phase ends here
+				timing.stats->record(timing.queued, timing.started, timing.completed, timing.completed);
 			}
 
 			return LUA_OK;
@@ -385,57 +962,198 @@ namespace iris {
 			return ngx_hooker_t::get_instance().event_handler(ev);
 		}
 
-		ngx_int_t process_events(ngx_cycle_t* cycle, ngx_msec_t timer, ngx_uint_t flags) {
-			// dig out sleep placeholder events...
-			if (offset_http_co_ctx_event_queue != 0) {
-				for (auto* co_ctx : pending_lua_http_co_ctxs) {
-					ngx_queue_t* p = reinterpret_cast<ngx_queue_t*>(reinterpret_cast<uintptr_t>(co_ctx) + offset_http_co_ctx_event_queue);
-					ngx_queue_remove(p);
-				}
+		static void ngx_notify_event_handler(ngx_event_t* ev) {
+			return ngx_hooker_t::get_instance().notify_event_handler(ev);
+		}
+
+		// register an eventfd (or a pipe on other posix platforms) of this worker process as a read event,
+		// so completions wake up nginx without ngx_notify(), which only holds one handler,
+		// is shared with other modules (e.g. thread pools) and is not supported by select/poll event modules.
+		void prepare_notify_event(ngx_cycle_t* cycle) {
+#ifndef _WIN32
+			if (notify_prepared) {
+				return;
+			}
+
+			notify_prepared = true;
+			if (ngx_add_channel_event == nullptr) {
+				return;
+			}
+
+#ifdef __linux__
+			int read_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			int write_fd = read_fd;
+			if (read_fd == -1) {
+				return;
+			}
+#else
+			int fds[2];
+			if (::pipe(fds) != 0) {
+				return;
+			}
+
+			for (int fd : fds) {
+				::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+				::fcntl(fd, F_SETFD, FD_CLOEXEC);
 			}
 
-			pending_lua_http_co_ctxs.clear();
+			int read_fd = fds[0];
+			int write_fd = fds[1];
+#endif
 
-			if (offset_stream_co_ctx_event_queue != 0) {
-				for (auto* co_ctx : pending_stream_http_co_ctxs) {
-					ngx_queue_t* p = reinterpret_cast<ngx_queue_t*>(reinterpret_cast<uintptr_t>(co_ctx) + offset_stream_co_ctx_event_queue);
-					ngx_queue_remove(p);
+			if (ngx_add_channel_event(cycle, read_fd, ngx_read_event, &ngx_hooker_t::ngx_notify_event_handler) != ngx_ok) {
+				::close(read_fd);
+				if (write_fd != read_fd) {
+					::close(write_fd);
 				}
+
+				return;
 			}
 
-			pending_stream_http_co_ctxs.clear();
+			notify_read_fd = read_fd;
+			notify_fd.store(write_fd, std::memory_order_release);
+#endif
+		}
 
+		// resume completed coroutines in one batch, leftovers beyond the per-tick budget are carried to next tick
+		void drain() {
+			bool pending = false;
+			size_t executed = 0;
 			do {
+				// polling the main warp flushes it and notifies again, so only retry after a pass that made progress
+				executed = 0;
+				// instances may be collected by gc steps in process_events(), index it rather than iterating
+				for (size_t i = 0; i < cpp_list.size(); i++) {
+					ngx_lua_cpp_t* p = cpp_list[i];
+					size_t task_count = p->drain_task_count;
+					pending = p->process_events() || pending;
+					executed += p->drain_task_count - task_count;
+				}
+			} while (!pending && notified.exchange(0, std::memory_order_relaxed) == 1 && executed != 0);
+
+			if (pending) {
+				// the wakeup may be consumed already, force a new one
+				notified.store(0, std::memory_order_relaxed);
+				notify();
+			}
+		}
+
+		ngx_int_t process_events(ngx_cycle_t* cycle, ngx_msec_t timer, ngx_uint_t flags) {
+			prepare_notify_event(cycle);
+			for (ngx_lua_cpp_t* p : cpp_list) {
+				p->begin_tick();
+			}
+
+			drain();
+
+			if (!ngx_queue_empty(ngx_posted_delayed_events)) {
+				// resumed coroutines are waiting in ngx_posted_delayed_events, do not block on polling
+				timer = 0;
+			} else {
+				// wake up for the nearest C++ timer that the main thread has to expire
+				auto deadline = std::chrono::steady_clock::time_point::max();
 				for (ngx_lua_cpp_t* p : cpp_list) {
-					p->process_events();
+					deadline = std::min(deadline, p->get_next_deadline());
+				}
+
+				if (deadline != std::chrono::steady_clock::time_point::max()) {
+					auto now = std::chrono::steady_clock::now();
+					timer = std::min(timer, deadline <= now ? ngx_msec_t(0) : static_cast<ngx_msec_t>(std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count()));
+				}
+
+				if (notify_fd.load(std::memory_order_relaxed) == -1 && actions->notify == nullptr) {
+					// if target platform does not support notify(), then modify timer interval (win32).
+					timer = std::min(timer, ngx_msec_t(16u));
 				}
-			} while (notified.exchange(0, std::memory_order_relaxed) == 1);
 
-			if (actions->notify == nullptr) {
-				// if target platform does not support notify(), then modify timer interval (win32).
-				timer = std::min(timer, ngx_msec_t(16u));
+				// nginx is going to block, spend part of the idle window on incremental gc.
+				// once per tick, not per instance: a step may collect instances
+				if (timer != 0 && !vm_states.empty() && idle_gc.step_size != 0 && idle_gc.time_budget.count() != 0) {
+					auto start = std::chrono::steady_clock::now();
+					step_idle_gc(timer);
+
+					if (timer != ngx_timer_infinite) {
+						ngx_msec_t elapsed = static_cast<ngx_msec_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+						timer = timer > elapsed ? timer - elapsed : 0;
+					}
+				}
 			}
 
 			return prev_ngx_process_events(cycle, timer, flags);
 		}
 
+		// run budgeted gc steps before nginx blocks for at most timer milliseconds
+		void step_idle_gc(ngx_msec_t timer) {
+			// ngx_timer_infinite is ~0, compare in milliseconds before converting
+			auto budget = idle_gc.time_budget;
+			if (timer != ngx_timer_infinite && timer <= static_cast<ngx_msec_t>(budget.count()) / 1000) {
+				budget = std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(timer) * 1000);
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			auto deadline = start + budget;
+			auto now = start;
+
+			// vms share the budget, each one gets at least one step
+			for (const std::unique_ptr<vm_state_t>& vm : vm_states) {
+				do {
+					idle_gc.step_count++;
+					if (lua_gc(vm->gc_state, LUA_GCSTEP, static_cast<int>(idle_gc.step_size)) != 0) {
+						// a cycle is finished, do not start another one in the same window
+						idle_gc.cycle_count++;
+						now = std::chrono::steady_clock::now();
+						break;
+					}
+
+					now = std::chrono::steady_clock::now();
+				} while (now < deadline);
+			}
+
+			idle_gc.time_spent += std::chrono::duration_cast<std::chrono::microseconds>(now - start);
+		}
+
 		static void event_handler(ngx_event_t* ev) {}
 
+		void notify_event_handler(ngx_event_t*) {
+#ifndef _WIN32
+			uint64_t value[8];
+			while (::read(notify_read_fd, &value, sizeof(value)) == static_cast<ssize_t>(sizeof(value))) {}
+#endif
+			drain();
+		}
+
 		ngx_int_t(*prev_ngx_process_events)(ngx_cycle_t* cycle, ngx_msec_t timer, ngx_uint_t flags) = nullptr;
 		std::vector<ngx_lua_cpp_t*> cpp_list;
 		std::atomic<size_t> notified = 0;
+		std::vector<iris_key_value_t<lua_State*, pending_return_t>> pending_returns;
+		std::vector<std::unique_ptr<vm_state_t>> vm_states;
+		lua_Integer thread_tag_serial = 0;
+		size_t thread_tags_prune_size = 64;
+		std::vector<iris_key_value_t<lua_State*, thread_tags_t>> thread_tags;
+		size_t expired_call_count = 0;
+		std::vector<std::string> binding_names;
+		idle_gc_t idle_gc;
+		std::vector<std::unique_ptr<call_context_t>> call_contexts;
+		std::vector<call_context_t*> free_call_contexts;
+		std::vector<iris_key_value_t<lua_State*, call_context_t*>> pending_calls;
+		std::vector<call_context_t*> abandoned_calls;
+		call_context_t* current_call = nullptr;
+		void (*http_sleep_cleanup)(void* data) = nullptr;
+		void (*stream_sleep_cleanup)(void* data) = nullptr;
 		ngx_event_actions_t* actions = nullptr;
 		ngx_module_t* ngx_http_lua_module = nullptr;
 		ngx_module_t* ngx_stream_lua_module = nullptr;
 		ngx_http_lua_co_ctx_t* (*ngx_http_lua_get_co_ctx)(lua_State* L, ngx_http_lua_ctx_t* ctx) = nullptr;
 		ngx_stream_lua_co_ctx_t* (*ngx_stream_lua_get_co_ctx)(lua_State* L, ngx_stream_lua_ctx_t* ctx) = nullptr;
+		ngx_int_t (*ngx_add_channel_event)(ngx_cycle_t* cycle, ngx_fd_t fd, ngx_int_t event, ngx_event_handler_pt handler) = nullptr;
 		int (*ngx_http_lua_yield)(lua_State*) = nullptr;
 		int (*ngx_stream_lua_yield)(lua_State*) = nullptr;
-		std::vector<ngx_http_lua_co_ctx_t*> pending_lua_http_co_ctxs;
-		std::vector<ngx_stream_lua_co_ctx_t*> pending_stream_http_co_ctxs;
 		int offset_http_co_ctx_event_queue = 0;
 		int offset_stream_co_ctx_event_queue = 0;
 		ngx_queue_t* ngx_posted_delayed_events = nullptr;
+		std::atomic<int> notify_fd = -1; // write side
+		int notify_read_fd = -1;
+		bool notify_prepared = false;
 	};
 
 	ngx_lua_cpp_t::ngx_lua_cpp_t() : async_worker(std::make_shared<iris_async_worker_t<>>()) {
@@ -448,7 +1166,7 @@ namespace iris {
 			});
 
 			return true;
-		});
+		}, 0);
 	}
 
 	void ngx_lua_cpp_t::reset_main_warp() {
@@ -468,29 +1186,235 @@ namespace iris {
 		ngx_hooker_t::get_instance().remove(this);
 	}
 
-	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::start(size_t thread_count) {
-		if (async_worker->get_current_thread_index() != ~(size_t)0) {
-			return iris_lua_t::result_error_t("ngx_lua_cpp_t::start(thread_count) -> incorrect current thread, please call me in main thread.");
-		}
+#ifdef __linux__
+	static int ngx_read_sysfs_int(const char* path) {
+		int value = 0;
+		if (FILE* fp = fopen(path, "r")) {
+			if (fscanf(fp, "%d", &value) != 1) {
+				value = 0;
+			}
 
-		if (is_running()) {
-			return iris_lua_t::result_error_t("ngx_lua_cpp_t::start(thread_count) -> already started.");
+			fclose(fp);
 		}
 
-		if (thread_count > std::thread::hardware_concurrency() * 4) {
-			thread_count = std::thread::hardware_concurrency() * 4;
+		return value;
+	}
+#endif
+
+	// cpus allowed for current process, sorted by numa node, package and core so that neighbours share caches
+	static std::vector<size_t> ngx_get_sorted_cpus() {
+		std::vector<size_t> cpus;
+#ifdef __linux__
+		cpu_set_t mask;
+		CPU_ZERO(&mask);
+		if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+			return cpus;
 		}
 
-		async_worker->resize(thread_count);
-		main_thread_index = async_worker->append(std::thread()); // for main thread polling
-		async_worker->start();
+		// cpu -> numa node
+		std::vector<int> nodes(CPU_SETSIZE, 0);
+		if (DIR* dir = opendir("/sys/devices/system/node")) {
+			while (struct dirent* entry = readdir(dir)) {
+				int node;
+				if (sscanf(entry->d_name, "node%d", &node) == 1) {
+					char path[64];
+					snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+					if (FILE* fp = fopen(path, "r")) {
+						// ranges like "0-7,16-23"
+						int from, to;
+						while (fscanf(fp, "%d", &from) == 1) {
+							to = from;
+							if (fscanf(fp, "-%d", &to) != 1) {
+								to = from;
+							}
+
+							for (int cpu = from; cpu <= to && cpu < CPU_SETSIZE; cpu++) {
+								nodes[cpu] = node;
+							}
+
+							if (fgetc(fp) != ',') {
+								break;
+							}
+						}
+
+						fclose(fp);
+					}
+				}
+			}
 
-		if (!ngx_warp_t::is_strand) {
-			reset_main_warp();
+			closedir(dir);
 		}
 
-		return {};
-	}
+		std::vector<std::array<int, 4>> infos;
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &mask)) {
+				char path[96];
+				snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+				int package = ngx_read_sysfs_int(path);
+				snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+				int core = ngx_read_sysfs_int(path);
+				infos.push_back({ nodes[cpu], package, core, cpu });
+			}
+		}
+
+		std::sort(infos.begin(), infos.end());
+		for (auto& info : infos) {
+			cpus.emplace_back(static_cast<size_t>(info[3]));
+		}
+#endif
+		return cpus;
+	}
+
+	// ngx.worker.id() and ngx.worker.count(), returns false outside worker processes
+	static bool ngx_get_worker_id(lua_State* L, size_t& id, size_t& count) {
+		int top = lua_gettop(L);
+		bool ret = false;
+		lua_getglobal(L, "ngx");
+		if (lua_istable(L, -1)) {
+			lua_getfield(L, -1, "worker");
+			if (lua_istable(L, -1)) {
+				lua_getfield(L, -1, "id");
+				lua_getfield(L, -2, "count");
+				if (lua_isfunction(L, -2) && lua_isfunction(L, -1)) {
+					if (lua_pcall(L, 0, 1, 0) == 0 && lua_isnumber(L, -1)) {
+						count = static_cast<size_t>(lua_tointeger(L, -1));
+						lua_pop(L, 1);
+						if (lua_pcall(L, 0, 1, 0) == 0 && lua_isnumber(L, -1)) {
+							id = static_cast<size_t>(lua_tointeger(L, -1));
+							ret = count != 0 && id < count;
+						}
+					}
+				}
+			}
+		}
+
+		lua_settop(L, top);
+		return ret;
+	}
+
+	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::start(iris_lua_t lua, iris_lua_t::stackindex_t config) {
+		// start(thread_count) or start({ compute = thread_count, blocking = blocking_thread_count })
+		lua_State* L = lua.get_state();
+		size_t thread_count = 0;
+		size_t blocking_thread_count = 0;
+		if (lua_istable(L, config.index)) {
+			lua_getfield(L, config.index, "compute");
+			thread_count = static_cast<size_t>(lua_tointeger(L, -1));
+			lua_getfield(L, config.index, "blocking");
+			blocking_thread_count = static_cast<size_t>(lua_tointeger(L, -1));
+			lua_pop(L, 2);
+		} else if (lua_isnumber(L, config.index)) {
+			thread_count = static_cast<size_t>(lua_tointeger(L, config.index));
+		} else {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::start(thread_count) -> thread_count must be a number or { compute = n, blocking = n }.");
+		}
+
+		if (async_worker->get_current_thread_index() != ~(size_t)0) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::start(thread_count) -> incorrect current thread, please call me in main thread.");
+		}
+
+		if (is_running()) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::start(thread_count) -> already started.");
+		}
+
+		if (thread_count > std::thread::hardware_concurrency() * 4) {
+			thread_count = std::thread::hardware_concurrency() * 4;
+		}
+
+		// threads beyond thread_count are reserved for resize() and autoscaling
+		size_t capacity = std::min(std::max(reserved_thread_count, thread_count), size_t(std::thread::hardware_concurrency() * 4));
+
+		topology_cpus.clear();
+		if (topology_enabled && thread_count != 0) {
+			size_t worker_id = 0, worker_count = 1;
+			if (!ngx_get_worker_id(lua.get_state(), worker_id, worker_count)) {
+				return iris_lua_t::result_error_t("ngx_lua_cpp_t::start(thread_count) -> topology mode requires ngx.worker.id(), please call me in init_worker_by_lua*.");
+			}
+
+			// a disjoint range of cpus for each nginx worker, or a shared one if there are more workers than cpus
+			std::vector<size_t> cpus = ngx_get_sorted_cpus();
+			if (!cpus.empty()) {
+				size_t begin = worker_id * cpus.size() / worker_count;
+				size_t end = (worker_id + 1) * cpus.size() / worker_count;
+				if (begin == end) {
+					topology_cpus.emplace_back(cpus[worker_id % cpus.size()]);
+				} else {
+					topology_cpus.assign(cpus.begin() + begin, cpus.begin() + end);
+				}
+			} else {
+				// unknown layout, just size it
+				size_t cpu_count = std::max(size_t(std::thread::hardware_concurrency()) / worker_count, (size_t)1);
+				thread_count = std::min(thread_count, cpu_count);
+				capacity = std::min(capacity, cpu_count);
+			}
+		}
+
+		if (!topology_cpus.empty()) {
+			// one thread per cpu of the partition
+			thread_count = std::min(thread_count, topology_cpus.size());
+			capacity = std::min(capacity, topology_cpus.size());
+#ifdef __linux__
+			async_worker->set_thread_init_handler([cpus = topology_cpus](size_t i) {
+				cpu_set_t mask;
+				CPU_ZERO(&mask);
+				CPU_SET(static_cast<int>(cpus[i % cpus.size()]), &mask);
+				pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+			});
+#endif
+		} else {
+			async_worker->set_thread_init_handler(nullptr);
+		}
+
+		async_worker->resize(capacity);
+		async_worker->scale(thread_count);
+		main_thread_index = async_worker->append(std::thread()); // for main thread polling
+		async_worker->start();
+
+		if (blocking_thread_count != 0) {
+			// elastic pool for blocking calls, grows fast when threads are stuck and shrinks slowly
+			blocking_thread_count = std::min(blocking_thread_count, size_t(std::thread::hardware_concurrency() * 64));
+			blocking_worker = std::make_shared<iris_async_worker_t<>>();
+			blocking_worker->resize(blocking_thread_count);
+			blocking_worker->scale(std::min(blocking_thread_count, size_t(std::thread::hardware_concurrency())));
+			blocking_worker->start();
+			blocking_warp = std::make_unique<ngx_warp_t>(*blocking_worker);
+
+			iris_async_scaler_t<iris_async_worker_t<>>::config_t blocking_config;
+			blocking_config.min_thread_count = 1;
+			blocking_config.max_thread_count = blocking_thread_count;
+			blocking_config.interval = std::chrono::milliseconds(20);
+			blocking_config.grow_sojourn = std::chrono::microseconds(2000);
+			blocking_config.shrink_sojourn = std::chrono::microseconds(200);
+			blocking_config.grow_depth = 1;
+			blocking_config.grow_window = 1;
+			blocking_config.shrink_window = 1500; // 30 seconds
+			blocking_scaler = std::make_unique<iris_async_scaler_t<iris_async_worker_t<>>>(*blocking_worker, blocking_config);
+		}
+
+		if (!ngx_warp_t::is_strand) {
+			reset_main_warp();
+		}
+
+		// rebuilt per start on the current worker, calls of the last run are drained by stop()
+		size_t slot_count = tenant_slot_count != 0 ? tenant_slot_count : std::max(thread_count, size_t(1));
+		tenant_gates.clear();
+		tenant_queue.reset();
+		tenant_quota = std::make_unique<iris_quota_t<size_t, 1>>(std::array<size_t, 1>{ slot_count });
+		tenant_queue = std::make_unique<ngx_tenant_queue_t>(*async_worker, *tenant_quota);
+		for (size_t weight : tenant_weights) {
+			tenant_gates.emplace_back(*tenant_queue, tenant_queue->add_tenant(weight));
+		}
+
+		size_t strand_count = keyed_strand_count != 0 ? keyed_strand_count : 64;
+		keyed_strands.reserve(strand_count);
+		for (size_t i = 0; i < strand_count; i++) {
+			keyed_strands.emplace_back(*async_worker);
+		}
+
+		keyed_counters.resize(strand_count);
+
+		return {};
+	}
 
 	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::stop() {
 		if (!is_running()) {
@@ -502,44 +1426,411 @@ namespace iris {
 	}
 
 	void ngx_lua_cpp_t::stop_impl() {
+		// blocking pool first, its completions still go to the compute pool
+		// tasks queued to it after joined are executed in place
+		if (blocking_worker) {
+			blocking_worker->terminate();
+			blocking_worker->join();
+		}
+
 		async_worker->terminate();
 		async_worker->join();
 
-		// manually polling events
-		while (main_warp->poll()) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		// manually polling events of the main warp, the keyed strands
+		// and the blocking warp as one group. tasks of any of them may queue to the others, so none is destroyed until all are empty
+		while (true) {
+			bool pending = ngx_strand_t::poll(keyed_strands.begin(), keyed_strands.end());
+			pending = main_warp->poll() || pending;
+			if (blocking_warp) {
+				pending = blocking_warp->poll() || pending;
+			}
+
+			if (pending) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			} else if (main_warp->empty() && (!blocking_warp || (blocking_warp->empty() && blocking_worker->empty())) && async_worker->empty()
+				&& std::all_of(keyed_strands.begin(), keyed_strands.end(), [](const ngx_strand_t& strand) { return strand.empty(); })) {
+				break;
+			}
+		}
+
+		keyed_strands.clear();
+		keyed_counters.clear();
+
+		if (blocking_worker) {
+			blocking_scaler.reset();
+			blocking_warp.reset();
+			blocking_worker.reset();
 		}
 
 		main_thread_index = ~(size_t)0;
 		reset_main_warp();
 	}
 
+	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::set_topology(bool enabled) {
+		if (is_running()) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::set_topology(enabled) -> already started.");
+		}
+
+		topology_enabled = enabled;
+		return {};
+	}
+
+	std::vector<size_t> ngx_lua_cpp_t::get_topology() const {
+		return topology_cpus;
+	}
+
+	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::reserve(size_t thread_count) {
+		if (is_running()) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::reserve(thread_count) -> already started.");
+		}
+
+		reserved_thread_count = thread_count;
+		return {};
+	}
+
+	void ngx_lua_cpp_t::set_qos(size_t reserved_thread_count) noexcept {
+		qos_reserved_thread_count = reserved_thread_count;
+	}
+
+	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::with_qos(iris_lua_t lua, std::string_view lane) {
+		size_t index;
+		if (lane == "interactive") {
+			index = ngx_qos_interactive;
+		} else if (lane == "default") {
+			index = ngx_qos_default;
+		} else if (lane == "batch") {
+			index = ngx_qos_batch;
+		} else {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::with_qos(lane) -> lane must be \"interactive\", \"default\" or \"batch\".");
+		}
+
+		ngx_hooker_t::get_instance().set_qos(lua.get_state(), index);
+		return {};
+	}
+
+	void ngx_lua_cpp_t::with_deadline(iris_lua_t lua, size_t milliseconds) {
+		ngx_hooker_t::get_instance().set_deadline(lua.get_state(), milliseconds == 0 ? std::chrono::steady_clock::time_point::max() : std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds));
+	}
+
+	std::unordered_map<std::string, size_t> ngx_lua_cpp_t::get_deadline_statistics() const {
+		return {
+			{ "expired_call_count", ngx_hooker_t::get_instance().get_expired_call_count() },
+			{ "expired_task_count", async_worker->get_expired_task_count() }
+		};
+	}
+
+	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::set_tenant_slots(size_t slot_count) {
+		if (is_running()) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::set_tenant_slots(slot_count) -> already started.");
+		}
+
+		tenant_slot_count = slot_count;
+		return {};
+	}
+
+	size_t ngx_lua_cpp_t::get_tenant_index(std::string_view name) {
+		for (size_t i = 0; i < tenant_names.size(); i++) {
+			if (tenant_names[i] == name) {
+				return i;
+			}
+		}
+
+		tenant_names.emplace_back(name);
+		tenant_weights.emplace_back(1);
+		if (tenant_queue) {
+			tenant_gates.emplace_back(*tenant_queue, tenant_queue->add_tenant(1));
+		}
+
+		return tenant_names.size() - 1;
+	}
+
+	ngx_tenant_gate_t* ngx_lua_cpp_t::get_tenant_gate(std::string_view name) {
+		size_t index = name.empty() ? 0 : get_tenant_index(name);
+		return index < tenant_gates.size() ? &tenant_gates[index] : nullptr;
+	}
+
+	void ngx_lua_cpp_t::with_tenant(iris_lua_t lua, std::string_view name) {
+		get_tenant_index(name);
+		ngx_hooker_t::get_instance().set_tenant(lua.get_state(), name);
+	}
+
+	void ngx_lua_cpp_t::set_tenant_weight(std::string_view name, size_t weight) {
+		size_t index = get_tenant_index(name);
+		tenant_weights[index] = std::max(weight, size_t(1));
+		if (tenant_queue) {
+			tenant_queue->set_weight(index, tenant_weights[index]);
+		}
+	}
+
+	std::unordered_map<std::string, std::unordered_map<std::string, size_t>> ngx_lua_cpp_t::get_tenant_statistics() const {
+		std::unordered_map<std::string, std::unordered_map<std::string, size_t>> result;
+		for (size_t i = 0; i < tenant_names.size(); i++) {
+			ngx_tenant_queue_t::statistics_t stats;
+			if (tenant_queue) {
+				stats = tenant_queue->get_statistics(i);
+			}
+
+			result[tenant_names[i]] = {
+				{ "weight", tenant_weights[i] },
+				{ "queued_count", stats.queued_count },
+				{ "running_count", stats.running_count },
+				{ "task_count", stats.acquired_count },
+				{ "busy_time", static_cast<size_t>(stats.busy_time / 1000) }
+			};
+		}
+
+		return result;
+	}
+
+	// priority p is polled only if less than (thread count - p) threads are busy, so p threads are kept for lower values
+	size_t ngx_lua_cpp_t::get_qos_priority(size_t lane) const noexcept {
+		switch (lane) {
+			case ngx_qos_interactive:
+				return 0;
+			case ngx_qos_batch:
+				return qos_reserved_thread_count;
+			default:
+				return qos_reserved_thread_count / 2;
+		}
+	}
+
+	iris_lua_t::optional_result_t<size_t> ngx_lua_cpp_t::resize(size_t thread_count) {
+		if (!is_running()) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::resize(thread_count) -> not started.");
+		}
+
+		size_t capacity = async_worker->get_thread_count() - 1;
+		if (thread_count == 0 || thread_count > capacity) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::resize(thread_count) -> thread_count must be in [1, reserved thread count].");
+		}
+
+		return async_worker->scale(thread_count);
+	}
+
+	void ngx_lua_cpp_t::set_autoscale(size_t min_thread_count, size_t max_thread_count, size_t grow_microseconds, size_t shrink_microseconds) {
+		if (max_thread_count == 0) {
+			scaler.reset();
+			return;
+		}
+
+		autoscale_config = {};
+		autoscale_config.min_thread_count = std::max(min_thread_count, (size_t)1);
+		autoscale_config.max_thread_count = std::max(max_thread_count, autoscale_config.min_thread_count);
+		reserved_thread_count = std::max(reserved_thread_count, autoscale_config.max_thread_count);
+		if (grow_microseconds != 0) {
+			autoscale_config.grow_sojourn = std::chrono::microseconds(grow_microseconds);
+		}
+
+		if (shrink_microseconds != 0) {
+			autoscale_config.shrink_sojourn = std::chrono::microseconds(shrink_microseconds);
+		}
+
+		scaler = std::make_unique<iris_async_scaler_t<iris_async_worker_t<>>>(*async_worker, autoscale_config);
+	}
+
+	std::unordered_map<std::string, size_t> ngx_lua_cpp_t::get_autoscale_statistics() const {
+		return {
+			{ "blocking_thread_count", blocking_worker ? blocking_worker->get_active_thread_count() : 0 },
+			{ "thread_count", async_worker->get_active_thread_count() },
+			{ "max_thread_count", async_worker->get_thread_count() == 0 ? 0 : async_worker->get_thread_count() - 1 },
+			{ "sojourn", scaler ? static_cast<size_t>(scaler->get_last_sojourn().count()) : 0 },
+			{ "depth", scaler ? scaler->get_last_depth() : 0 }
+		};
+	}
+
+	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::set_keyed_strands(size_t strand_count) {
+		if (is_running()) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::set_keyed_strands(strand_count) -> already started.");
+		}
+
+		keyed_strand_count = strand_count;
+		return {};
+	}
+
+	ngx_strand_t* ngx_lua_cpp_t::get_keyed_strand(std::string_view key) noexcept {
+		if (keyed_strands.empty()) {
+			return nullptr;
+		}
+
+		return &keyed_strands[std::hash<std::string_view>()(key) % keyed_strands.size()];
+	}
+
+	iris_switch_t<ngx_strand_t> ngx_lua_cpp_t::switch_keyed(std::string_view key) noexcept {
+		return iris_switch(get_keyed_strand(key));
+	}
+
+	iris_coroutine_t<lua_Integer> ngx_lua_cpp_t::keyed_add(std::string key, lua_Integer delta) {
+		ngx_strand_t* strand = get_keyed_strand(key);
+		if (strand == nullptr) {
+			co_return std::move(delta);
+		}
+
+		// counters of a strand are only touched on it, no lock is needed
+		auto& counters = keyed_counters[strand - keyed_strands.data()];
+		ngx_warp_t* current = ngx_warp_t::get_current();
+		co_await iris_switch(strand);
+		lua_Integer value = counters[key] += delta;
+		co_await iris_switch(current);
+
+		co_return std::move(value);
+	}
+
+	iris_lua_t::refptr_t<ngx_shared_table_t> ngx_lua_cpp_t::new_shared_table(iris_lua_t lua) {
+		iris_lua_t::refptr_t<ngx_shared_table_t> table = lua.make_registry_object<ngx_shared_table_t>(this);
+
+		// the table keeps its owner (self at index 1) alive, calls on it are forwarded to the owner
+		lua_State* L = lua.get_state();
+		lua_rawgeti(L, LUA_REGISTRYINDEX, table.get_ref_index());
+		ngx_hooker_t::get_instance().anchor(L, -1, 1);
+		lua_pop(L, 1);
+
+		return table;
+	}
+
 	bool ngx_lua_cpp_t::is_running() const noexcept {
 		return !async_worker->is_terminated();
 	}
 
 	iris_coroutine_t<size_t> ngx_lua_cpp_t::sleep(size_t millseconds) {
-		ngx_warp_t* current = co_await iris_switch<ngx_warp_t>(nullptr);
-		std::this_thread::sleep_for(std::chrono::milliseconds(millseconds));
-		co_await iris_switch(current);
+		if (millseconds == 0) {
+			// still a full round trip through the worker pool
+			ngx_warp_t* current = ngx_warp_t::get_current();
+			co_await iris_switch<ngx_warp_t>(nullptr);
+			co_await iris_switch(current);
+		} else {
+			// parked in the timer wheel, no pool thread is occupied
+			co_await iris_delay<ngx_warp_t>(*async_worker, std::chrono::milliseconds(millseconds));
+		}
+
 		co_return std::move(millseconds);
 	}
 
+	iris_coroutine_t<size_t> ngx_lua_cpp_t::spin(size_t microseconds) {
+		ngx_call_trace_t* trace = ngx_call_trace_t::get_current();
+		ngx_warp_t* current = ngx_warp_t::get_current();
+		co_await iris_switch<ngx_warp_t>(nullptr);
+
+		// the time spent while yielded counts too, so a spin never runs longer than requested
+		auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(microseconds);
+		size_t yield_count = 0;
+		while (true) {
+			auto now = std::chrono::steady_clock::now();
+			if (now >= end) {
+				break;
+			}
+
+			// a piece of work, at most 50 microseconds
+			auto piece = std::min(end, now + std::chrono::microseconds(50));
+			while (std::chrono::steady_clock::now() < piece) {}
+
+			if (co_await yield_if_exhausted(trace)) {
+				yield_count++;
+			}
+		}
+
+		co_await iris_switch(current);
+		co_return std::move(yield_count);
+	}
+
 	size_t ngx_lua_cpp_t::get_hardware_concurrency() const noexcept {
 		return std::thread::hardware_concurrency();
 	}
 
+	void ngx_lua_cpp_t::lua_method_begin(iris_lua_t lua, ngx_lua_cpp_t* self, bool is_coroutine) {
+		if (is_coroutine) {
+			ngx_hooker_t& hooker = ngx_hooker_t::get_instance();
+			lua_State* L = lua.get_state();
+			if (!self->subsystem_resolved) {
+				// an instance never moves between lua vms
+				self->is_stream = !hooker.is_http_context(L);
+				self->subsystem_resolved = true;
+			}
+
+			size_t index = hooker.resolve_binding(L);
+			if (self->admission && !self->admit(index)) {
+				// fail fast before any call context is created, no c++ objects are alive in the caller frame
+				lua_pushliteral(L, "overloaded");
+				lua_error(L);
+			}
+
+			// pool tasks of every call pass the gate of its tenant
+			const ngx_hooker_t::thread_tags_t* tags = hooker.find_thread_tags(L);
+			hooker.begin_call(L, self->is_stream, self->qos_reserved_thread_count == 0 ? 0 : self->get_qos_priority(tags != nullptr ? tags->qos : ngx_qos_default), tags != nullptr ? tags->deadline : std::chrono::steady_clock::time_point::max(),
+				self->get_tenant_gate(tags != nullptr ? std::string_view(tags->tenant) : std::string_view()));
+
+			ngx_call_trace_t* trace = hooker.get_current_trace();
+			trace->time_slice = self->get_time_slice(index);
+			if (index != ~size_t(0)) {
+				trace->queued = std::chrono::steady_clock::now();
+				trace->stats = self->get_binding_stats(index);
+			}
+		}
+	}
+
+	void ngx_lua_cpp_t::lua_method_end(iris_lua_t lua, ngx_lua_cpp_t*, bool is_coroutine) {
+		if (is_coroutine) {
+			ngx_hooker_t::get_instance().end_call(lua.get_state());
+		}
+	}
+
 	void ngx_lua_cpp_t::lua_registar(iris_lua_t lua, iris_lua_traits_t<ngx_lua_cpp_t>) {
 		ngx_hooker_t::get_instance().registar(lua);
 
 		lua.set_current_new<&iris_lua_t::place_new_object<ngx_lua_cpp_t>>("new");
 		lua.set_current<&ngx_lua_cpp_t::start>("start");
 		lua.set_current<&ngx_lua_cpp_t::stop>("stop");
+		lua.set_current<&ngx_lua_cpp_t::reserve>("reserve");
+		lua.set_current<&ngx_lua_cpp_t::set_topology>("set_topology");
+		lua.set_current<&ngx_lua_cpp_t::get_topology>("get_topology");
+		lua.set_current<&ngx_lua_cpp_t::resize>("resize");
+		lua.set_current<&ngx_lua_cpp_t::set_autoscale>("set_autoscale");
+		lua.set_current<&ngx_lua_cpp_t::set_qos>("set_qos");
+		lua.set_current<&ngx_lua_cpp_t::with_qos>("with_qos");
+		lua.set_current<&ngx_lua_cpp_t::with_deadline>("with_deadline");
+		lua.set_current<&ngx_lua_cpp_t::get_deadline_statistics>("get_deadline_statistics");
+		lua.set_current<&ngx_lua_cpp_t::set_admission>("set_admission");
+		lua.set_current<&ngx_lua_cpp_t::set_binding_admission>("set_binding_admission");
+		lua.set_current<&ngx_lua_cpp_t::get_admission_statistics>("get_admission_statistics");
+		lua.set_current<&ngx_lua_cpp_t::set_time_slice>("set_time_slice");
+		lua.set_current<&ngx_lua_cpp_t::set_binding_time_slice>("set_binding_time_slice");
+		lua.set_current<&ngx_lua_cpp_t::set_tenant_slots>("set_tenant_slots");
+		lua.set_current<&ngx_lua_cpp_t::with_tenant>("with_tenant");
+		lua.set_current<&ngx_lua_cpp_t::set_tenant_weight>("set_tenant_weight");
+		lua.set_current<&ngx_lua_cpp_t::get_tenant_statistics>("get_tenant_statistics");
+		lua.set_current<&ngx_lua_cpp_t::get_autoscale_statistics>("get_autoscale_statistics");
+		lua.set_current<&ngx_lua_cpp_t::set_keyed_strands>("set_keyed_strands");
+		lua.set_current<&ngx_lua_cpp_t::keyed_add>("keyed_add");
+
+		// run_keyed(key, name, ...) calls the keyed binding name(key, ...), it runs its work on the strand of the key.
+		// the strand is never held across lua code, so nested and concurrent keyed calls never wait for each other
+		const std::string_view run_keyed =
+			"local error = error\n"
+			"local keyed = { keyed_add = true }\n"
+			"return function (self, key, name, ...)\n"
+			"	if not self:is_running() then\n"
+			"		error(\"ngx_lua_cpp_t::run_keyed(key, name, ...) -> not started.\")\n"
+			"	end\n"
+			"	if not keyed[name] then\n"
+			"		error(\"ngx_lua_cpp_t::run_keyed(key, name, ...) -> not a keyed binding.\")\n"
+			"	end\n"
+			"	return self[name](self, key, ...)\n"
+			"end\n";
+		lua.set_current("run_keyed", lua.call<iris_lua_t::ref_t>(lua.load(run_keyed, "=(ngx_lua_cpp)")));
+		lua.set_current<&ngx_lua_cpp_t::new_shared_table>("new_shared_table");
+		lua.deref(lua.make_registry_type<ngx_shared_table_t>());
 		lua.set_current<&ngx_lua_cpp_t::is_running>("is_running");
 		lua.set_current<&ngx_lua_cpp_t::get_hardware_concurrency>("get_hardware_concurrency");
 		lua.set_current<&ngx_lua_cpp_t::sleep>("sleep");
+		lua.set_current<&ngx_lua_cpp_t::spin>("spin");
+		lua.set_current<&ngx_lua_cpp_t::set_drain_budget>("set_drain_budget");
+		lua.set_current<&ngx_lua_cpp_t::get_drain_statistics>("get_drain_statistics");
+		lua.set_current<&ngx_lua_cpp_t::set_idle_gc>("set_idle_gc");
+		lua.set_current<&ngx_lua_cpp_t::get_idle_gc_statistics>("get_idle_gc_statistics");
+
+		lua.set_current<&ngx_lua_cpp_t::get_stats>("stats");
 
 		lua.set_current<&ngx_lua_cpp_t::__async_worker__>("__async_worker__");
+		ngx_hooker_t::get_instance().register_bindings(lua.get_state(), -1);
 	}
 
 	void* ngx_lua_cpp_t::__async_worker__(void* new_async_worker_ptr) {
@@ -556,24 +1847,394 @@ namespace iris {
 
 		std::swap(async_worker, worker);
 		reset_main_warp();
+
+		if (scaler) {
+			scaler = std::make_unique<iris_async_scaler_t<iris_async_worker_t<>>>(*async_worker, autoscale_config);
+		}
+
+		if (admission) {
+			admission = std::make_unique<iris_async_admission_t<iris_async_worker_t<>>>(*async_worker, admission_config);
+		}
+
 		return true;
 	}
 
-	void ngx_lua_cpp_t::process_events() {
+	void ngx_lua_cpp_t::set_drain_budget(size_t task_count, size_t microseconds) noexcept {
+		drain_task_budget = drain_task_left = task_count;
+		drain_time_budget = std::chrono::microseconds(microseconds);
+		drain_deadline = std::chrono::steady_clock::now() + drain_time_budget;
+	}
+
+	std::unordered_map<std::string, size_t> ngx_lua_cpp_t::get_drain_statistics() const {
+		return {
+			{ "tick_count", drain_tick_count },
+			{ "task_count", drain_task_count },
+			{ "budget_hit_count", drain_budget_hit_count }
+		};
+	}
+
+	void ngx_lua_cpp_t::begin_tick() {
+		drain_tick_count++;
+		drain_task_left = drain_task_budget;
+		drain_exhausted = false;
+		if (drain_time_budget.count() != 0) {
+			drain_deadline = std::chrono::steady_clock::now() + drain_time_budget;
+		}
+
+		if (is_running()) {
+			if (scaler) {
+				scaler->tick();
+			}
+
+			if (admission) {
+				admission->tick();
+			}
+
+			if (blocking_scaler) {
+				blocking_scaler->tick();
+			}
+		}
+	}
+
+	void ngx_lua_cpp_t::set_idle_gc(size_t step_size, size_t microseconds) noexcept {
+		ngx_hooker_t::idle_gc_t& idle_gc = ngx_hooker_t::get_instance().get_idle_gc();
+		idle_gc.step_size = step_size;
+		idle_gc.time_budget = std::chrono::microseconds(microseconds);
+	}
+
+	std::unordered_map<std::string, size_t> ngx_lua_cpp_t::get_idle_gc_statistics() const {
+		const ngx_hooker_t::idle_gc_t& idle_gc = ngx_hooker_t::get_instance().get_idle_gc();
+		return {
+			{ "step_count", idle_gc.step_count },
+			{ "cycle_count", idle_gc.cycle_count },
+			{ "microseconds", static_cast<size_t>(idle_gc.time_spent.count()) }
+		};
+	}
+
+	void ngx_lua_cpp_t::set_admission(size_t target_microseconds, size_t interval_milliseconds) {
+		if (target_microseconds == 0) {
+			admission.reset();
+		} else {
+			admission_config.target = std::chrono::microseconds(target_microseconds);
+			admission_config.interval = std::chrono::milliseconds(interval_milliseconds == 0 ? 100 : interval_milliseconds);
+			admission = std::make_unique<iris_async_admission_t<iris_async_worker_t<>>>(*async_worker, admission_config);
+		}
+	}
+
+	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::set_binding_admission(std::string_view name, size_t target_microseconds) {
+		const std::vector<std::string>& names = ngx_hooker_t::get_instance().get_binding_names();
+		auto it = std::find(names.begin(), names.end(), name);
+		if (it == names.end()) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::set_binding_admission(name, target_microseconds) -> unknown coroutine binding.");
+		}
+
+		size_t index = static_cast<size_t>(it - names.begin());
+		if (index >= binding_admission_targets.size()) {
+			binding_admission_targets.resize(index + 1, ~size_t(0));
+		}
+
+		binding_admission_targets[index] = target_microseconds;
+		return {};
+	}
+
+	void ngx_lua_cpp_t::set_time_slice(size_t microseconds) noexcept {
+		time_slice = microseconds;
+	}
+
+	iris_lua_t::optional_result_t<void> ngx_lua_cpp_t::set_binding_time_slice(std::string_view name, size_t microseconds) {
+		const std::vector<std::string>& names = ngx_hooker_t::get_instance().get_binding_names();
+		auto it = std::find(names.begin(), names.end(), name);
+		if (it == names.end()) {
+			return iris_lua_t::result_error_t("ngx_lua_cpp_t::set_binding_time_slice(name, microseconds) -> unknown coroutine binding.");
+		}
+
+		size_t index = static_cast<size_t>(it - names.begin());
+		if (index >= binding_time_slices.size()) {
+			binding_time_slices.resize(index + 1, ~size_t(0));
+		}
+
+		binding_time_slices[index] = microseconds;
+		return {};
+	}
+
+	std::chrono::microseconds ngx_lua_cpp_t::get_time_slice(size_t index) const noexcept {
+		size_t slice = index < binding_time_slices.size() && binding_time_slices[index] != ~size_t(0) ? binding_time_slices[index] : time_slice;
+		return slice == 0 ? std::chrono::microseconds::max() : std::chrono::microseconds(slice);
+	}
+
+	iris_yield_if_exhausted_t<ngx_warp_t, std::chrono::microseconds> ngx_lua_cpp_t::yield_if_exhausted(ngx_call_trace_t* trace) noexcept {
+		return iris_yield_if_exhausted<ngx_warp_t>(*async_worker, trace != nullptr ? trace->time_slice : std::chrono::microseconds::max());
+	}
+
+	std::unordered_map<std::string, size_t> ngx_lua_cpp_t::get_admission_statistics() const {
+		if (!admission) {
+			return {};
+		}
+
+		return {
+			{ "rejected_count", admission->get_rejected_count() },
+			{ "standing_sojourn", static_cast<size_t>(admission->get_standing_sojourn().count()) },
+			{ "last_sojourn", static_cast<size_t>(admission->get_last_sojourn().count()) }
+		};
+	}
+
+	bool ngx_lua_cpp_t::admit(size_t index) {
+		size_t target = index < binding_admission_targets.size() ? binding_admission_targets[index] : ~size_t(0);
+		if (target == ~size_t(0)) {
+			return admission->admit();
+		} else {
+			// zero means never rejected
+			return target == 0 || admission->admit(std::chrono::microseconds(target));
+		}
+	}
+
+	ngx_binding_stats_t* ngx_lua_cpp_t::get_binding_stats(size_t index) {
+		if (index >= binding_stats.size()) {
+			binding_stats.resize(index + 1);
+		}
+
+		if (!binding_stats[index]) {
+			binding_stats[index] = std::make_unique<ngx_binding_stats_t>();
+		}
+
+		return binding_stats[index].get();
+	}
+
+	std::unordered_map<std::string, std::unordered_map<std::string, std::unordered_map<std::string, size_t>>> ngx_lua_cpp_t::get_stats() const {
+		auto summary = [](const ngx_histogram_t& histogram) {
+			return std::unordered_map<std::string, size_t> {
+				{ "count", static_cast<size_t>(histogram.get_count()) },
+				{ "p50", static_cast<size_t>(histogram.get_percentile(0.5)) },
+				{ "p90", static_cast<size_t>(histogram.get_percentile(0.9)) },
+				{ "p99", static_cast<size_t>(histogram.get_percentile(0.99)) },
+				{ "p999", static_cast<size_t>(histogram.get_percentile(0.999)) },
+				{ "max", static_cast<size_t>(histogram.get_max()) }
+			};
+		};
+
+		const std::vector<std::string>& names = ngx_hooker_t::get_instance().get_binding_names();
+		std::unordered_map<std::string, std::unordered_map<std::string, std::unordered_map<std::string, size_t>>> stats;
+		for (size_t i = 0; i < binding_stats.size() && i < names.size(); i++) {
+			if (binding_stats[i]) {
+				const ngx_binding_stats_t& binding = *binding_stats[i];
+				stats[names[i]] = {
+					{ "queue", summary(binding.queue) },
+					{ "run", summary(binding.run) },
+					{ "resume", summary(binding.resume) },
+					{ "total", summary(binding.total) }
+				};
+			}
+		}
+
+		return stats;
+	}
+
+	size_t ngx_histogram_t::get_bucket_index(uint64_t value) noexcept {
+		value = std::min(value, (uint64_t(1) << max_value_bits) - 1);
+		if (value < sub_bucket_count) {
+			return static_cast<size_t>(value);
+		}
+
+		size_t shift = static_cast<size_t>(63 - std::countl_zero(value)) - sub_bucket_bits;
+		return (shift + 1) * sub_bucket_count + static_cast<size_t>((value >> shift) - sub_bucket_count);
+	}
+
+	// upper bound of values in the bucket
+	uint64_t ngx_histogram_t::get_bucket_value(size_t index) noexcept {
+		if (index < sub_bucket_count) {
+			return index;
+		}
+
+		size_t shift = index / sub_bucket_count - 1;
+		uint64_t sub_bucket = index % sub_bucket_count + sub_bucket_count;
+		return ((sub_bucket + 1) << shift) - 1;
+	}
+
+	void ngx_histogram_t::record(uint64_t value) noexcept {
+		buckets[get_bucket_index(value)]++;
+		max_value = std::max(max_value, value);
+		count++;
+	}
+
+	uint64_t ngx_histogram_t::get_percentile(double ratio) const noexcept {
+		if (count == 0) {
+			return 0;
+		}
+
+		uint64_t target = std::max(uint64_t(1), static_cast<uint64_t>(std::ceil(ratio * static_cast<double>(count))));
+		uint64_t sum = 0;
+		for (size_t i = 0; i < bucket_count; i++) {
+			sum += buckets[i];
+			if (sum >= target) {
+				return std::min(get_bucket_value(i), max_value);
+			}
+		}
+
+		return max_value;
+	}
+
+	void ngx_binding_stats_t::record(time_point_t queued, time_point_t started, time_point_t completed, time_point_t resumed) noexcept {
+		auto microseconds = [](time_point_t from, time_point_t to) {
+			return to > from ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count()) : uint64_t(0);
+		};
+
+		// calls that never run on a worker thread (e.g. parked in the timer wheel) only have resume and total phases
+		if (started != time_point_t()) {
+			queue.record(microseconds(queued, started));
+			run.record(microseconds(started, completed));
+		}
+
+		resume.record(microseconds(completed, resumed));
+		total.record(microseconds(queued, resumed));
+	}
+
+	ngx_call_trace_t* ngx_call_trace_t::get_current() noexcept {
+		return ngx_hooker_t::get_instance().get_current_trace();
+	}
+
+	// deadline of delayed tasks that must be expired by the main thread
+	std::chrono::steady_clock::time_point ngx_lua_cpp_t::get_next_deadline() const noexcept {
+		if (async_worker->get_thread_count() <= 1 || async_worker->is_terminated()) {
+			return async_worker->get_next_timer_deadline();
+		} else {
+			// keep sampling for the autoscaler even if nginx is idle
+			auto deadline = scaler ? scaler->get_next_sample() : std::chrono::steady_clock::time_point::max();
+			// the blocking pool is only sampled while it is busy or not shrunk yet, get_task_count() is too heavy for every tick
+			if (blocking_scaler && (blocking_worker->get_active_thread_count() > 1 || blocking_worker->get_running_count() != 0)) {
+				deadline = std::min(deadline, blocking_scaler->get_next_sample());
+			}
+
+			return deadline;
+		}
+	}
+
+	// returns true if there are tasks left for next tick
+	bool ngx_lua_cpp_t::process_events() {
 		if (async_worker->get_thread_count() <= 1 || async_worker->is_terminated()) {
 			async_worker->make_current(main_thread_index);
 			// if there is no worker threads, try polling from main_thread
+			async_worker->poll_timers();
 			async_worker->poll();
 			async_worker->make_current(~(size_t)0);
 		}
 
-		main_warp->poll<false>();
+		if (!drain_exhausted) {
+			bool limited = false;
+			bool pending = main_warp->poll_budget([this, &limited]() noexcept {
+				drain_task_count++;
+				if (drain_task_budget != 0 && --drain_task_left == 0) {
+					limited = true;
+				} else if (drain_time_budget.count() != 0 && std::chrono::steady_clock::now() >= drain_deadline) {
+					limited = true;
+				}
+
+				return !limited;
+			});
+
+			if (pending && limited) {
+				drain_exhausted = true;
+				drain_budget_hit_count++;
+			}
+		}
+
+		return drain_exhausted;
+	}
+
+	ngx_shared_table_t::ngx_shared_table_t(ngx_lua_cpp_t* owner_instance) : owner(owner_instance), async_worker(owner_instance->get_async_worker()), shared(ngx_shared_state_t<map_t>::make_shared(async_worker)) {}
+
+	void ngx_shared_table_t::lua_registar(iris_lua_t lua, iris_lua_traits_t<ngx_shared_table_t>) {
+		lua.set_current<&ngx_shared_table_t::get>("get");
+		lua.set_current<&ngx_shared_table_t::get_many>("get_many");
+		lua.set_current<&ngx_shared_table_t::size>("size");
+		lua.set_current<&ngx_shared_table_t::set>("set");
+		lua.set_current<&ngx_shared_table_t::remove>("remove");
+		lua.set_current<&ngx_shared_table_t::replace>("replace");
+		ngx_hooker_t::get_instance().register_bindings(lua.get_state(), -1);
+	}
+
+	void ngx_shared_table_t::lua_method_begin(iris_lua_t lua, ngx_shared_table_t* self, bool is_coroutine) {
+		// calls are traced, admitted and tagged by the owner
+		ngx_lua_cpp_t::lua_method_begin(lua, self->owner, is_coroutine);
+	}
+
+	void ngx_shared_table_t::lua_method_end(iris_lua_t lua, ngx_shared_table_t* self, bool is_coroutine) {
+		ngx_lua_cpp_t::lua_method_end(lua, self->owner, is_coroutine);
+	}
+
+	iris_coroutine_t<std::optional<std::string>> ngx_shared_table_t::get(std::string key) {
+		std::shared_ptr<ngx_shared_state_t<map_t>> state = shared;
+		co_return co_await state->read([&key](const map_t& map) -> std::optional<std::string> {
+			auto it = map.find(key);
+			if (it != map.end()) {
+				return it->second;
+			} else {
+				return std::nullopt;
+			}
+		});
+	}
+
+	iris_coroutine_t<ngx_shared_table_t::map_t> ngx_shared_table_t::get_many(std::vector<std::string> keys) {
+		std::shared_ptr<ngx_shared_state_t<map_t>> state = shared;
+		co_return co_await state->read([&keys](const map_t& map) {
+			map_t values;
+			for (const std::string& key : keys) {
+				auto it = map.find(key);
+				if (it != map.end()) {
+					values.emplace(*it);
+				}
+			}
+
+			return values;
+		});
+	}
+
+	iris_coroutine_t<size_t> ngx_shared_table_t::size() {
+		std::shared_ptr<ngx_shared_state_t<map_t>> state = shared;
+		co_return co_await state->read([](const map_t& map) {
+			return map.size();
+		});
+	}
+
+	iris_coroutine_t<void> ngx_shared_table_t::set(std::string key, std::string value) {
+		std::shared_ptr<ngx_shared_state_t<map_t>> state = shared;
+		co_await state->write([&key, &value](map_t& map) {
+			map.insert_or_assign(std::move(key), std::move(value));
+		});
+	}
+
+	iris_coroutine_t<void> ngx_shared_table_t::remove(std::string key) {
+		std::shared_ptr<ngx_shared_state_t<map_t>> state = shared;
+		co_await state->write([&key](map_t& map) {
+			map.erase(key);
+		});
+	}
+
+	iris_coroutine_t<void> ngx_shared_table_t::replace(map_t entries) {
+		std::shared_ptr<ngx_shared_state_t<map_t>> state = shared;
+		co_await state->write([&entries](map_t& map) {
+			map.swap(entries);
+		});
+
+		// large tables take a while to free, not on the nginx thread
+		ngx_warp_t* current = ngx_warp_t::get_current();
+		if (current != nullptr) {
+			co_await iris_switch<ngx_warp_t>(nullptr);
+			entries = map_t();
+			co_await iris_switch(current);
+		}
 	}
 
 	void ngx_warp_t::flush_warp() {
 		ngx_hooker_t::get_instance().notify();
 	}
 
+	void ngx_strand_t::flush_warp() {
+		// without worker threads, the pool is polled by the nginx thread only
+		if (get_async_worker().get_thread_count() <= 1) {
+			ngx_hooker_t::get_instance().notify();
+		}
+	}
+
 	int ngx_lua_cpp_resume(lua_State* L, int narg) {
 		return ngx_hooker_t::get_instance().ngx_lua_cpp_resume(L, narg);
 	}
@@ -79,26 +79,271 @@ namespace iris {
 		void flush_warp();
 	};
 
+	// strand of keyed calls, its tasks run one by one in queueing order
+	struct ngx_strand_t : iris_warp_t<iris_async_worker_t<>, true, ngx_strand_t> {
+		using base_t = iris_warp_t<iris_async_worker_t<>, true, ngx_strand_t>;
+		template <typename... args_t>
+		ngx_strand_t(args_t&&... args) : base_t(std::forward<args_t>(args)...) {}
+		static ngx_strand_t* get_current() noexcept {
+			return static_cast<ngx_strand_t*>(base_t::get_current());
+		}
+
+		void enter_warp() {}
+		void leave_warp() {}
+
+		size_t enter_join_warp() {
+			return 0;
+		}
+
+		size_t leave_join_warp() {
+			return 0;
+		}
+
+		void suspend_warp() {}
+		void resume_warp() {}
+		void flush_warp();
+	};
+
+	// state shared by coroutines without locks. reads run as parallel routines of a strand, writes as its exclusive routines:
+	// a write waits for running reads, reads queued meanwhile wait for the write
+	template <typename state_t>
+	struct ngx_shared_state_t {
+		template <typename... args_t>
+		ngx_shared_state_t(iris_async_worker_t<>& async_worker, args_t&&... args) : warp(async_worker), state(std::forward<args_t>(args)...) {}
+		~ngx_shared_state_t() noexcept {
+			// only the strand, tasks of the pool are not ours to run
+			while (warp.template poll<false>()) {}
+		}
+
+		// shared state destroyed on the pool once its strand is idle, the last owner never blocks (e.g. in a __gc finalizer)
+		template <typename... args_t>
+		static std::shared_ptr<ngx_shared_state_t> make_shared(std::shared_ptr<iris_async_worker_t<>> async_worker, args_t&&... args) {
+			ngx_shared_state_t* instance = new ngx_shared_state_t(*async_worker, std::forward<args_t>(args)...);
+			return std::shared_ptr<ngx_shared_state_t>(instance, [async_worker](ngx_shared_state_t* p) {
+				release(async_worker, p);
+			});
+		}
+
+		// co_await read(func) returns func(const state_t&) called on the pool, then switches back to the current warp or the pool
+		template <typename func_t>
+		iris_coroutine_t<std::invoke_result_t<func_t&, const state_t&>> read(func_t func) {
+			ngx_warp_t* current = ngx_warp_t::get_current();
+			co_await iris_switch(&warp, static_cast<ngx_strand_t*>(nullptr), true);
+			if constexpr (std::is_void_v<std::invoke_result_t<func_t&, const state_t&>>) {
+				func(std::as_const(state));
+				co_await leave(current);
+			} else {
+				auto result = func(std::as_const(state));
+				co_await leave(current);
+				co_return std::move(result);
+			}
+		}
+
+		// co_await write(func) returns func(state_t&) called exclusively, then switches back to the current warp or the pool
+		template <typename func_t>
+		iris_coroutine_t<std::invoke_result_t<func_t&, state_t&>> write(func_t func) {
+			ngx_warp_t* current = ngx_warp_t::get_current();
+			co_await iris_switch(&warp);
+			if constexpr (std::is_void_v<std::invoke_result_t<func_t&, state_t&>>) {
+				func(state);
+				co_await leave(current);
+			} else {
+				auto result = func(state);
+				co_await leave(current);
+				co_return std::move(result);
+			}
+		}
+
+	protected:
+		static void release(const std::shared_ptr<iris_async_worker_t<>>& async_worker, ngx_shared_state_t* instance) {
+			auto task = [async_worker, instance]() {
+				if (instance->warp.is_idle()) {
+					delete instance;
+				} else {
+					release(async_worker, instance);
+				}
+			};
+
+			if (async_worker->is_terminated()) {
+				// run after the tasks of the strand while joining, or in place once joined
+				async_worker->queue(std::move(task));
+			} else {
+				async_worker->queue_delayed(std::move(task), std::chrono::milliseconds(1));
+			}
+		}
+
+		static iris_coroutine_t<void> leave(ngx_warp_t* current) {
+			if (current != nullptr) {
+				co_await iris_switch(current);
+			} else {
+				co_await iris_switch<ngx_strand_t>(nullptr);
+			}
+		}
+
+		ngx_strand_t warp;
+		state_t state;
+	};
+
+	// log-linear latency histogram in microseconds, 16 sub-buckets per power of two
+	struct ngx_histogram_t {
+		static constexpr size_t sub_bucket_bits = 4;
+		static constexpr size_t sub_bucket_count = size_t(1) << sub_bucket_bits;
+		static constexpr size_t max_value_bits = 40;
+		static constexpr size_t bucket_count = (max_value_bits - sub_bucket_bits + 1) * sub_bucket_count;
+
+		void record(uint64_t value) noexcept;
+		uint64_t get_percentile(double ratio) const noexcept;
+		uint64_t get_count() const noexcept { return count; }
+		uint64_t get_max() const noexcept { return max_value; }
+
+	protected:
+		static size_t get_bucket_index(uint64_t value) noexcept;
+		static uint64_t get_bucket_value(size_t index) noexcept;
+
+		std::array<uint64_t, bucket_count> buckets = {};
+		uint64_t count = 0;
+		uint64_t max_value = 0;
+	};
+
+	// phases of coroutine binding calls: queue (queued -> started on worker), run (started -> co_return),
+	// resume (co_return -> resumed in lua) and total
+	struct ngx_binding_stats_t {
+		using time_point_t = std::chrono::steady_clock::time_point;
+		void record(time_point_t queued, time_point_t started, time_point_t completed, time_point_t resumed) noexcept;
+
+		ngx_histogram_t queue;
+		ngx_histogram_t run;
+		ngx_histogram_t resume;
+		ngx_histogram_t total;
+	};
+
+	// timestamps of a coroutine binding call
+	struct ngx_call_trace_t {
+		// trace of the binding being invoked, capture it before the first co_await
+		static ngx_call_trace_t* get_current() noexcept;
+
+		// the call is started the first time it runs on a worker thread, see iris_cancel_token_t::start()
+		std::chrono::steady_clock::time_point queued;
+		ngx_binding_stats_t* stats = nullptr;
+		std::chrono::microseconds time_slice = std::chrono::microseconds::max(); // see ngx_lua_cpp_t::yield_if_exhausted()
+	};
+
+	// pool slots shared by tenants, waiters are woken by weighted deficit round-robin
+	using ngx_tenant_queue_t = iris_quota_fair_queue_t<iris_quota_t<size_t, 1>, ngx_warp_t>;
+
+	// pool tasks of a call pass the gate of its tenant, holding a slot from being queued to the pool until they return
+	struct ngx_tenant_gate_t : iris_cancel_token_t::gate_t {
+		ngx_tenant_gate_t(ngx_tenant_queue_t& q, size_t t) noexcept : queue(q), tenant(t) {}
+
+		void enter(std::function<void()>&& dispatch) override {
+			queue.queue(tenant, { 1 }, std::move(dispatch));
+		}
+
+		void leave(std::chrono::steady_clock::duration busy_time) noexcept override {
+			queue.release(tenant, { 1 }, busy_time);
+		}
+
+	protected:
+		ngx_tenant_queue_t& queue;
+		size_t tenant;
+	};
+
+	struct ngx_shared_table_t;
 	struct ngx_lua_cpp_t {
 	public:
 		ngx_lua_cpp_t();
 		~ngx_lua_cpp_t() noexcept;
 
 		static void lua_registar(iris_lua_t lua, iris_lua_traits_t<ngx_lua_cpp_t>);
-		iris_lua_t::optional_result_t<void> start(size_t thread_count);
+		static void lua_method_begin(iris_lua_t lua, ngx_lua_cpp_t* self, bool is_coroutine);
+		static void lua_method_end(iris_lua_t lua, ngx_lua_cpp_t* self, bool is_coroutine);
+		// start(thread_count) or start({ compute = thread_count, blocking = max_blocking_thread_count })
+		iris_lua_t::optional_result_t<void> start(iris_lua_t lua, iris_lua_t::stackindex_t config);
 		iris_lua_t::optional_result_t<void> stop();
+		// give each nginx worker a disjoint cpu partition, size the pool to it and pin threads, before start()
+		iris_lua_t::optional_result_t<void> set_topology(bool enabled);
+		// cpus of the partition, empty if not pinned
+		std::vector<size_t> get_topology() const;
+		// reserve threads for resize() before start()
+		iris_lua_t::optional_result_t<void> reserve(size_t thread_count);
+		// change the count of running threads online, up to the reserved count
+		iris_lua_t::optional_result_t<size_t> resize(size_t thread_count);
+		// scale threads in [min_thread_count, max_thread_count] by queue depth and sojourn time, zero max_thread_count means disabled
+		void set_autoscale(size_t min_thread_count, size_t max_thread_count, size_t grow_microseconds, size_t shrink_microseconds);
+		std::unordered_map<std::string, size_t> get_autoscale_statistics() const;
+		// keep reserved_thread_count threads away from batch calls, half of them away from default calls
+		void set_qos(size_t reserved_thread_count) noexcept;
+		// tag calls of the running lua coroutine with a lane: "interactive", "default" or "batch"
+		iris_lua_t::optional_result_t<void> with_qos(iris_lua_t lua, std::string_view lane);
+		// give calls of the running lua coroutine a deadline from now, zero means none.
+		// expired calls are cancelled, calls with work skipped for it return nil, "timeout"
+		void with_deadline(iris_lua_t lua, size_t milliseconds);
+		std::unordered_map<std::string, size_t> get_deadline_statistics() const;
+		// reject coroutine bindings with error "overloaded" while the standing queue sojourn time exceeds target, zero target means disabled
+		void set_admission(size_t target_microseconds, size_t interval_milliseconds);
+		// per binding target, zero means never rejected
+		iris_lua_t::optional_result_t<void> set_binding_admission(std::string_view name, size_t target_microseconds);
+		std::unordered_map<std::string, size_t> get_admission_statistics() const;
+		// pool slots shared by all tenants before start(), zero means the compute thread count
+		iris_lua_t::optional_result_t<void> set_tenant_slots(size_t slot_count);
+		// tag calls of the running lua coroutine with a tenant, created with weight 1 if unknown
+		void with_tenant(iris_lua_t lua, std::string_view name);
+		// a tenant wakes up to weight queued calls per round, untagged calls belong to tenant "default"
+		void set_tenant_weight(std::string_view name, size_t weight);
+		// stats[tenant] = { weight, queued_count, running_count, task_count, busy_time } of pool tasks, busy_time in microseconds
+		std::unordered_map<std::string, std::unordered_map<std::string, size_t>> get_tenant_statistics() const;
+		// default time slice of coroutine bindings running on the pool, zero means never yielding
+		void set_time_slice(size_t microseconds) noexcept;
+		// per binding time slice, zero means never yielding
+		iris_lua_t::optional_result_t<void> set_binding_time_slice(std::string_view name, size_t microseconds);
+		// co_await it in loops of long running work on the pool, requeues the call behind other tasks once its time slice is used up
+		iris_yield_if_exhausted_t<ngx_warp_t, std::chrono::microseconds> yield_if_exhausted(ngx_call_trace_t* trace) noexcept;
+		// strands shared by keys before start(), zero means 64
+		iris_lua_t::optional_result_t<void> set_keyed_strands(size_t strand_count);
+		// strand of the key, keys with the same hash share one. nullptr if not started
+		ngx_strand_t* get_keyed_strand(std::string_view key) noexcept;
+		// switch onto the strand of the key, calls of the same key run in order.
+		// leave it with co_await iris_switch(current), or iris_switch<ngx_strand_t>(nullptr) to the pool
+		iris_switch_t<ngx_strand_t> switch_keyed(std::string_view key) noexcept;
+		// example of keyed calls (see run_keyed): adds delta to the counter of the key on its strand, returns the new value
+		iris_coroutine_t<lua_Integer> keyed_add(std::string key, lua_Integer delta);
+		// string table shared by all requests of this nginx worker, see ngx_shared_table_t
+		iris_lua_t::refptr_t<ngx_shared_table_t> new_shared_table(iris_lua_t lua);
 		bool is_running() const noexcept;
 		size_t get_hardware_concurrency() const noexcept;
 		// example async demo: sleep
 		iris_coroutine_t<size_t> sleep(size_t milliseconds);
+		// example of time slicing: busy loop on the pool, returns how many times the time slice was used up
+		iris_coroutine_t<size_t> spin(size_t microseconds);
 		std::shared_ptr<iris_async_worker_t<>> get_async_worker() noexcept { return async_worker; }
+		// warp of the blocking pool, switch to it with co_await iris_switch(get_blocking_warp(), nullptr, true)
+		// nullptr if not configured, which falls back to the compute pool
+		ngx_warp_t* get_blocking_warp() noexcept { return blocking_warp.get(); }
+		// limit completions resumed per event loop tick, zero means unlimited
+		void set_drain_budget(size_t task_count, size_t microseconds) noexcept;
+		std::unordered_map<std::string, size_t> get_drain_statistics() const;
+		// latency percentiles of coroutine bindings: stats[binding][phase] = { count, p50, p90, p99, p999, max } in microseconds
+		std::unordered_map<std::string, std::unordered_map<std::string, std::unordered_map<std::string, size_t>>> get_stats() const;
+		// run incremental gc steps of step_size (KB) when nginx is idle, zero means disabled.
+		// gc is stepped once per tick for the lua vm, so the setting and statistics are shared by all instances
+		void set_idle_gc(size_t step_size, size_t microseconds) noexcept;
+		std::unordered_map<std::string, size_t> get_idle_gc_statistics() const;
 		
 		// inspect internal
 		void* __async_worker__(void* new_async_worker_ptr);
 
 	protected:
 		bool set_async_worker(std::shared_ptr<iris_async_worker_t<>> worker);
-		void process_events();
+		void begin_tick();
+		std::chrono::steady_clock::time_point get_next_deadline() const noexcept;
+		bool process_events();
+		ngx_binding_stats_t* get_binding_stats(size_t index);
+		size_t get_qos_priority(size_t lane) const noexcept;
+		bool admit(size_t index);
+		std::chrono::microseconds get_time_slice(size_t index) const noexcept;
+		size_t get_tenant_index(std::string_view name);
+		// gate of pool tasks of the tenant, nullptr if not started
+		ngx_tenant_gate_t* get_tenant_gate(std::string_view name);
 		void stop_impl();
 		void reset_main_warp();
 		friend struct ngx_hooker_t;
@@ -108,36 +353,119 @@ namespace iris {
 		std::unique_ptr<ngx_warp_t> main_warp;
 		std::unique_ptr<ngx_warp_t::preempt_guard_t> main_warp_guard;
 		size_t main_thread_index = ~(size_t)0;
+		bool subsystem_resolved = false;
+		bool is_stream = false;
+
+		// per-tick drain budget
+		size_t drain_task_budget = 0;
+		std::chrono::microseconds drain_time_budget = std::chrono::microseconds(0);
+		size_t drain_task_left = 0;
+		std::chrono::steady_clock::time_point drain_deadline;
+		bool drain_exhausted = false;
+
+		// drain statistics
+		size_t drain_tick_count = 0;
+		size_t drain_task_count = 0;
+		size_t drain_budget_hit_count = 0;
+
+		// topology
+		bool topology_enabled = false;
+		std::vector<size_t> topology_cpus;
+
+		// blocking pool
+		std::shared_ptr<iris_async_worker_t<>> blocking_worker;
+		std::unique_ptr<ngx_warp_t> blocking_warp;
+		std::unique_ptr<iris_async_scaler_t<iris_async_worker_t<>>> blocking_scaler;
+
+		// qos lanes
+		size_t qos_reserved_thread_count = 0;
+
+		// admission control, targets indexed by binding
+		iris_async_admission_t<iris_async_worker_t<>>::config_t admission_config;
+		std::unique_ptr<iris_async_admission_t<iris_async_worker_t<>>> admission;
+		std::vector<size_t> binding_admission_targets;
+
+		// time slices in microseconds, indexed by binding, ~0 means the default one
+		size_t time_slice = 0;
+		std::vector<size_t> binding_time_slices;
+
+		// keyed strands, recreated by each start(). counters of keyed_add, one map per strand only touched on it
+		size_t keyed_strand_count = 0;
+		std::vector<ngx_strand_t> keyed_strands;
+		std::vector<std::unordered_map<std::string, lua_Integer>> keyed_counters;
+
+		// tenants, indexed by ngx_call_trace_t::tenant, 0 is "default"
+		size_t tenant_slot_count = 0;
+		std::vector<std::string> tenant_names = { "default" };
+		std::vector<size_t> tenant_weights = { 1 };
+		std::unique_ptr<iris_quota_t<size_t, 1>> tenant_quota;
+		std::unique_ptr<ngx_tenant_queue_t> tenant_queue;
+		std::deque<ngx_tenant_gate_t> tenant_gates; // indexed as tenant_names, stable addresses on growth
+
+		// autoscaling
+		size_t reserved_thread_count = 0;
+		iris_async_scaler_t<iris_async_worker_t<>>::config_t autoscale_config;
+		std::unique_ptr<iris_async_scaler_t<iris_async_worker_t<>>> scaler;
+
+		// indexed by binding
+		std::vector<std::unique_ptr<ngx_binding_stats_t>> binding_stats;
+	};
+
+	// string table for large in-memory lookups, served by the pool: gets run in parallel, updates exclusively.
+	// created by inst:new_shared_table() and must not outlive inst
+	struct ngx_shared_table_t {
+		using map_t = std::unordered_map<std::string, std::string>;
+		ngx_shared_table_t(ngx_lua_cpp_t* owner_instance);
+
+		static void lua_registar(iris_lua_t lua, iris_lua_traits_t<ngx_shared_table_t>);
+		static void lua_method_begin(iris_lua_t lua, ngx_shared_table_t* self, bool is_coroutine);
+		static void lua_method_end(iris_lua_t lua, ngx_shared_table_t* self, bool is_coroutine);
+
+		// value of key, nil if not found
+		iris_coroutine_t<std::optional<std::string>> get(std::string key);
+		// values of keys, missing ones are skipped
+		iris_coroutine_t<map_t> get_many(std::vector<std::string> keys);
+		iris_coroutine_t<size_t> size();
+		iris_coroutine_t<void> set(std::string key, std::string value);
+		iris_coroutine_t<void> remove(std::string key);
+		// swap in new contents, the old ones are released on the pool
+		iris_coroutine_t<void> replace(map_t entries);
+
+	protected:
+		ngx_lua_cpp_t* owner; // kept alive by the lua object of the table, see ngx_lua_cpp_t::new_shared_table()
+		std::shared_ptr<iris_async_worker_t<>> async_worker;
+		std::shared_ptr<ngx_shared_state_t<map_t>> shared; // also held by calls in flight
 	};
 
 	template <typename>
-	struct is_non_void_iris_coroutine_instance : std::false_type {};
+	struct is_iris_coroutine_instance : std::false_type {};
 
 	template <typename return_t>
-	struct is_non_void_iris_coroutine_instance<iris_coroutine_t<return_t>> : std::bool_constant<!std::is_void_v<return_t>> {};
+	struct is_iris_coroutine_instance<iris_coroutine_t<return_t>> : std::true_type {};
 
 	template <typename return_t>
-	struct is_coroutine_non_void_return_t : std::false_type {};
+	struct is_coroutine_return_t : std::false_type {};
 
 	template <typename return_t, typename... args_t>
-	struct is_coroutine_non_void_return_t<return_t(*)(args_t...)>
-		: is_non_void_iris_coroutine_instance<std::remove_cvref_t<return_t>> {};
+	struct is_coroutine_return_t<return_t(*)(args_t...)>
+		: is_iris_coroutine_instance<std::remove_cvref_t<return_t>> {};
 
 	template <typename return_t, typename... args_t>
-	struct is_coroutine_non_void_return_t<return_t(args_t...)>
-		: is_non_void_iris_coroutine_instance<std::remove_cvref_t<return_t>> {};
+	struct is_coroutine_return_t<return_t(args_t...)>
+		: is_iris_coroutine_instance<std::remove_cvref_t<return_t>> {};
 
 	template <typename class_t, typename return_t, typename... args_t>
-	struct is_coroutine_non_void_return_t<return_t(class_t::*)(args_t...)>
-		: is_non_void_iris_coroutine_instance<std::remove_cvref_t<return_t>> {};
+	struct is_coroutine_return_t<return_t(class_t::*)(args_t...)>
+		: is_iris_coroutine_instance<std::remove_cvref_t<return_t>> {};
 
 	template <typename class_t, typename return_t, typename... args_t>
-	struct is_coroutine_non_void_return_t<return_t(class_t::*)(args_t...) const>
-		: is_non_void_iris_coroutine_instance<std::remove_cvref_t<return_t>> {};
+	struct is_coroutine_return_t<return_t(class_t::*)(args_t...) const>
+		: is_iris_coroutine_instance<std::remove_cvref_t<return_t>> {};
 
+	// coroutine bindings return through a lua wrapper fetching the stored returns, void ones too (nil, or nil, "timeout" if expired)
 	extern int ngx_iris_wrap_coroutine_with_returns_key;
 	template <typename type_t>
-	struct iris_lua_traits_t<type_t, std::enable_if_t<is_coroutine_non_void_return_t<type_t>::value>> {
+	struct iris_lua_traits_t<type_t, std::enable_if_t<is_coroutine_return_t<type_t>::value>> {
 		using type = iris_lua_traits_t<type_t>;
 		static constexpr bool value = true;
 